@@ -0,0 +1,375 @@
+// Benchmark for the library scanner.
+//
+// Builds a synthetic music library under a temporary directory and
+// scans it a few times, the same way the player does for the
+// directories given on the command line. Every scan runs in its own
+// process so that its peak RSS can be measured. One more scan is
+// run under ptrace() to count the syscalls it makes.
+//
+// Usage: ampire-bench-scan [options...]
+//     -d <n>    depth of the tree (default 3)
+//     -f <n>    subdirectories per directory (default 8)
+//     -n <n>    songs per directory (default 10)
+//     -x <n>    other files per directory (default 2)
+//     -l <n>    symlinks to random directories (default 0)
+//     -r <n>    number of timed runs (default 5)
+//     -i        use an index, the first run creates it
+//     -D        hand out files reachable through several paths once (--dedupe)
+//     -t <dir>  scan an existing directory instead of generating one
+//     -k        keep the generated tree
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ampire-scan.h"
+#include "ampire-flag.h"
+#include "dyn_array.h"
+#include "ds/array.h"
+
+struct {
+        uint32_t flags;
+        int volume;
+        int playlist;
+        int history_sz;
+        int playlist_sz;
+} g_config = {
+        .flags = FT_RECURSIVE,
+        .volume = -1,
+        .playlist = -1,
+        .history_sz = 1000,
+        .playlist_sz = 9,
+};
+
+typedef struct {
+        size_t  depth;
+        size_t  fanout;
+        size_t  nsongs;
+        size_t  nother;
+        size_t  nlinks;
+        size_t  nruns;
+        int     index;
+        int     keep;
+        char   *tree;
+} Bench_Opts;
+
+typedef struct {
+        double  secs;
+        size_t  nsongs;
+} Bench_Result;
+
+static double now(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//////////////////////////////////////////////////
+// Generator
+
+static size_t g_ndirs = 0, g_nfiles = 0;
+
+static void write_file(const char *path, const void *data, size_t n) {
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1) {
+                perror(path);
+                exit(1);
+        }
+        if (write(fd, data, n) != (ssize_t)n) {
+                perror("write");
+                exit(1);
+        }
+        close(fd);
+}
+
+static void gen_dir(const Bench_Opts *o, const char *dir, size_t level, Str_Array *dirs) {
+        // An empty ID3v2 tag, enough for the scanner to take it as a song.
+        static const char id3[10] = { 'I', 'D', '3', 3, 0, 0, 0, 0, 0, 0 };
+        char path[4096];
+
+        dyn_array_append(*dirs, strdup(dir));
+        ++g_ndirs;
+
+        for (size_t i = 0; i < o->nsongs; ++i) {
+                snprintf(path, sizeof(path), "%s/%02zu - Track %zu.mp3", dir, i+1, i+1);
+                write_file(path, id3, sizeof(id3));
+                ++g_nfiles;
+        }
+        for (size_t i = 0; i < o->nother; ++i) {
+                snprintf(path, sizeof(path), "%s/cover%zu.jpg", dir, i);
+                write_file(path, "\xff\xd8\xff\xe0", 4);
+        }
+
+        if (level >= o->depth) return;
+
+        for (size_t i = 0; i < o->fanout; ++i) {
+                snprintf(path, sizeof(path), "%s/Album %03zu", dir, i);
+                if (mkdir(path, 0755) == -1) {
+                        perror(path);
+                        exit(1);
+                }
+                gen_dir(o, path, level+1, dirs);
+        }
+}
+
+static void gen_tree(const Bench_Opts *o, const char *root) {
+        Str_Array dirs = dyn_array_empty(Str_Array);
+        gen_dir(o, root, 0, &dirs);
+
+        // Links may point up the tree and form loops, the scanner has to cope.
+        srand(1);
+        char path[4096];
+        for (size_t i = 0; i < o->nlinks; ++i) {
+                const char *from = dirs.data[rand() % dirs.len];
+                const char *to = dirs.data[rand() % dirs.len];
+                snprintf(path, sizeof(path), "%s/link%zu", from, i);
+                if (symlink(to, path) == -1) {
+                        perror("symlink");
+                }
+        }
+
+        for (size_t i = 0; i < dirs.len; ++i) {
+                free(dirs.data[i]);
+        }
+        dyn_array_free(dirs);
+}
+
+static int rm_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+        (void)st; (void)type; (void)ftw;
+        if (remove(path) == -1) perror(path);
+        return 0;
+}
+
+//////////////////////////////////////////////////
+// Scanning
+
+// Scan like the player does and hand everything out.
+static Bench_Result scan(const char *root, const char *indexfp) {
+        Str_Array roots = dyn_array_empty(Str_Array);
+        dyn_array_append(roots, (char *)root);
+
+        Str_Array songs = dyn_array_empty(Str_Array);
+
+        double start = now();
+        Scan *s = scan_start(&roots, indexfp);
+        while (!scan_drain(s, 0, 1, &songs, NULL)) {
+                usleep(1000);
+        }
+        scan_wait(s);
+        double end = now();
+
+        Bench_Result res = { .secs = end - start, .nsongs = songs.len };
+
+        scan_free(s);
+        dyn_array_free(songs);
+        dyn_array_free(roots);
+        return res;
+}
+
+// Run a scan in a child process. Returns the peak RSS of the child in KiB.
+static long scan_in_child(const char *root, const char *indexfp, Bench_Result *res) {
+        int fds[2];
+        if (pipe(fds) == -1) {
+                perror("pipe");
+                exit(1);
+        }
+
+        pid_t pid = fork();
+        if (pid == -1) {
+                perror("fork");
+                exit(1);
+        }
+        if (pid == 0) {
+                close(fds[0]);
+                Bench_Result r = scan(root, indexfp);
+                (void)!write(fds[1], &r, sizeof(r));
+                _exit(0);
+        }
+
+        close(fds[1]);
+        if (read(fds[0], res, sizeof(*res)) != sizeof(*res)) {
+                fprintf(stderr, "scan did not finish\n");
+                exit(1);
+        }
+        close(fds[0]);
+
+        int status;
+        struct rusage ru;
+        if (wait4(pid, &status, 0, &ru) == -1) {
+                perror("wait4");
+                exit(1);
+        }
+        return ru.ru_maxrss;
+}
+
+// Count the syscalls of a scan in a child process, across all of
+// its threads. Returns -1 if the child could not be traced.
+static long count_syscalls(const char *root, const char *indexfp) {
+        pid_t pid = fork();
+        if (pid == -1) {
+                perror("fork");
+                exit(1);
+        }
+        if (pid == 0) {
+                if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) == -1) _exit(2);
+                raise(SIGSTOP);
+                (void)scan(root, indexfp);
+                _exit(0);
+        }
+
+        int status;
+        if (waitpid(pid, &status, 0) == -1 || !WIFSTOPPED(status)) {
+                return -1;
+        }
+        ptrace(PTRACE_SETOPTIONS, pid, NULL,
+               PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL);
+        ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+
+        // Every syscall stops the thread twice, on entry and on exit.
+        long stops = 0;
+        for (;;) {
+                pid_t tid = waitpid(-1, &status, __WALL);
+                if (tid == -1) {
+                        if (errno == EINTR) continue;
+                        break;
+                }
+                if (WIFEXITED(status) || WIFSIGNALED(status)) {
+                        if (tid == pid) break;
+                        continue;
+                }
+
+                int sig = 0;
+                if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+                        ++stops;
+                } else if (WSTOPSIG(status) != SIGTRAP && WSTOPSIG(status) != SIGSTOP) {
+                        sig = WSTOPSIG(status);
+                }
+                ptrace(PTRACE_SYSCALL, tid, NULL, (void *)(intptr_t)sig);
+        }
+
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 2) {
+                return -1;
+        }
+        return stops / 2;
+}
+
+//////////////////////////////////////////////////
+// Main
+
+static size_t parse_num(const char *s, char flag) {
+        char *end;
+        long n = strtol(s, &end, 10);
+        if (*s == '\0' || *end != '\0' || n < 0) {
+                fprintf(stderr, "-%c expects a number, not `%s`\n", flag, s);
+                exit(1);
+        }
+        return (size_t)n;
+}
+
+static void usage(void) {
+        fprintf(stderr, "Usage: ampire-bench-scan [-d depth] [-f fanout] [-n songs] [-x others] "
+                        "[-l symlinks] [-r runs] [-i] [-D] [-t dir] [-k]\n");
+        exit(1);
+}
+
+int main(int argc, char **argv) {
+        Bench_Opts o = {
+                .depth = 3,
+                .fanout = 8,
+                .nsongs = 10,
+                .nother = 2,
+                .nlinks = 0,
+                .nruns = 5,
+                .index = 0,
+                .keep = 0,
+                .tree = NULL,
+        };
+
+        int c;
+        while ((c = getopt(argc, argv, "d:f:n:x:l:r:iDt:k")) != -1) {
+                switch (c) {
+                case 'd': o.depth = parse_num(optarg, c); break;
+                case 'f': o.fanout = parse_num(optarg, c); break;
+                case 'n': o.nsongs = parse_num(optarg, c); break;
+                case 'x': o.nother = parse_num(optarg, c); break;
+                case 'l': o.nlinks = parse_num(optarg, c); break;
+                case 'r': o.nruns = parse_num(optarg, c); break;
+                case 'i': o.index = 1; break;
+                case 'D': g_config.flags |= FT_DEDUPE; break;
+                case 't': o.tree = optarg; break;
+                case 'k': o.keep = 1; break;
+                default: usage();
+                }
+        }
+        if (o.nruns == 0) o.nruns = 1;
+
+        char tmpl[] = "/tmp/ampire-bench-XXXXXX";
+        char *root = o.tree ? realpath(o.tree, NULL) : mkdtemp(tmpl);
+        if (!root) {
+                perror(o.tree ? o.tree : "mkdtemp");
+                return 1;
+        }
+
+        if (!o.tree) {
+                double start = now();
+                gen_tree(&o, root);
+                printf("tree:     %s, %zu dirs, %zu songs, %zu symlinks (generated in %.2f s)\n",
+                       root, g_ndirs, g_nfiles, o.nlinks, now() - start);
+        } else {
+                printf("tree:     %s\n", root);
+        }
+
+        char indexfp[4096] = {0};
+        if (o.index) {
+                snprintf(indexfp, sizeof(indexfp), "%s.index", root);
+                (void)unlink(indexfp);
+        }
+
+        double best = 0.0;
+        size_t nsongs = 0;
+        long max_rss = 0;
+        for (size_t i = 0; i < o.nruns; ++i) {
+                Bench_Result r;
+                long rss = scan_in_child(root, o.index ? indexfp : NULL, &r);
+                printf("run %-4zu  %zu songs in %.4f s, %.0f files/s, peak RSS %.1f MiB%s\n",
+                       i+1, r.nsongs, r.secs, r.nsongs / r.secs, rss / 1024.0,
+                       o.index && i == 0 ? " (creating the index)" : "");
+                if (i == 0 || r.secs < best) best = r.secs;
+                if (rss > max_rss) max_rss = rss;
+                nsongs = r.nsongs;
+        }
+
+        long nsys = count_syscalls(root, o.index ? indexfp : NULL);
+
+        printf("best:     %.4f s, %.0f files/s\n", best, nsongs / best);
+        if (nsys >= 0) {
+                printf("syscalls: %ld, %.2f per file\n", nsys, nsongs ? (double)nsys / nsongs : 0.0);
+        } else {
+                printf("syscalls: could not trace the scan\n");
+        }
+        printf("peak RSS: %.1f MiB\n", max_rss / 1024.0);
+
+        if (o.index) {
+                (void)unlink(indexfp);
+        }
+        if (!o.tree && !o.keep) {
+                (void)nftw(root, rm_entry, 64, FTW_DEPTH | FTW_PHYS);
+        }
+        if (o.tree) {
+                free(root);
+        }
+
+        return 0;
+}
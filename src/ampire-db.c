@@ -0,0 +1,360 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ampire-db.h"
+#include "dyn_array.h"
+#include "ds/array.h"
+#include "ds/strmap.h"
+
+DYN_ARRAY_TYPE(uint32_t, U32_Array);
+DYN_ARRAY_TYPE(char, Char_Array);
+
+int db_open(const char *fp, Db *db) {
+        memset(db, 0, sizeof(Db));
+
+        int fd = open(fp, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return 0;
+
+        struct stat st;
+        if (fstat(fd, &st) == -1 || (size_t)st.st_size < offsetof(Db_Header, seq)) {
+                close(fd);
+                return 0;
+        }
+
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+                perror("mmap");
+                return 0;
+        }
+
+        const Db_Header *hdr = (const Db_Header *)map;
+        const size_t len = st.st_size;
+        // Version 1 did not have `seq` yet.
+        const size_t hdr_sz = hdr->version == 1 ? offsetof(Db_Header, seq) : sizeof(Db_Header);
+        const size_t table_end = hdr_sz + (size_t)hdr->nplaylists * sizeof(Db_Playlist);
+
+        if (memcmp(hdr->magic, DB_MAGIC, sizeof(hdr->magic))
+            || (hdr->version != 1 && hdr->version != DB_VERSION)
+            || hdr->size != len
+            || table_end > len
+            || hdr->strtab > len
+            || hdr->strtab_len > len - hdr->strtab
+            || (hdr->strtab_len > 0 && ((const char *)map)[hdr->strtab + hdr->strtab_len - 1] != '\0')) {
+                munmap(map, len);
+                return 0;
+        }
+
+        const Db_Playlist *playlists = (const Db_Playlist *)((const uint8_t *)map + hdr_sz);
+        for (uint32_t i = 0; i < hdr->nplaylists; ++i) {
+                const Db_Playlist *p = &playlists[i];
+                if (p->name >= hdr->strtab_len
+                    || p->songs % sizeof(uint32_t) != 0
+                    || p->songs > len
+                    || (uint64_t)p->nsongs * sizeof(uint32_t) > len - p->songs) {
+                        munmap(map, len);
+                        return 0;
+                }
+        }
+
+        db->map = (const uint8_t *)map;
+        db->len = len;
+        db->hdr = hdr;
+        db->playlists = playlists;
+        db->seq = hdr->version == 1 ? 0 : hdr->seq;
+        return 1;
+}
+
+void db_close(Db *db) {
+        if (db->map) {
+                munmap((void *)db->map, db->len);
+        }
+        memset(db, 0, sizeof(Db));
+}
+
+size_t db_len(const Db *db) {
+        return db->hdr ? db->hdr->nplaylists : 0;
+}
+
+static const char *db_str(const Db *db, uint32_t off) {
+        return (const char *)db->map + db->hdr->strtab + off;
+}
+
+const char *db_name(const Db *db, size_t i) {
+        assert(i < db_len(db));
+        return db_str(db, db->playlists[i].name);
+}
+
+size_t db_nsongs(const Db *db, size_t i) {
+        assert(i < db_len(db));
+        return db->playlists[i].nsongs;
+}
+
+const char *db_song(const Db *db, size_t i, size_t j) {
+        assert(j < db_nsongs(db, i));
+        const uint32_t *songs = (const uint32_t *)(db->map + db->playlists[i].songs);
+        return songs[j] < db->hdr->strtab_len ? db_str(db, songs[j]) : NULL;
+}
+
+void db_songs(const Db *db, size_t i, Str_Array *out) {
+        assert(i < db_len(db));
+        const Db_Playlist *p = &db->playlists[i];
+        const uint32_t *songs = (const uint32_t *)(db->map + p->songs);
+
+        dyn_array_reserve(*out, out->len + p->nsongs);
+
+        for (uint32_t j = 0; j < p->nsongs; ++j) {
+                if (songs[j] < db->hdr->strtab_len) {
+                        out->data[out->len++] = (char *)db_str(db, songs[j]);
+                }
+        }
+}
+
+static void noop_free(uint8_t *v) {
+        (void)v;
+}
+
+// Put `s` into the string table if it is not already in there.
+static uint32_t strtab_add(Char_Array *strtab, Str_Map *offsets, const char *s) {
+        uintptr_t off = (uintptr_t)strmap_get(offsets, s);
+        if (off) return (uint32_t)(off - 1);
+
+        if (strtab->cap == 0) {
+                dyn_array_reserve(*strtab, 64 * 1024);
+        }
+        off = strtab->len;
+        dyn_array_append_n(*strtab, s, strlen(s) + 1);
+        strmap_insert(offsets, (char *)s, (uint8_t *)(off + 1));
+        return (uint32_t)off;
+}
+
+size_t db_size_max(const Db_Entry *entries, size_t n) {
+        size_t size = sizeof(Db_Header) + n * sizeof(Db_Playlist);
+        for (size_t i = 0; i < n; ++i) {
+                size += strlen(entries[i].name) + 1;
+                for (size_t j = 0; j < entries[i].songfps->len; ++j) {
+                        size += sizeof(uint32_t) + strlen(entries[i].songfps->data[j]) + 1;
+                }
+        }
+        return size;
+}
+
+static int write_chunked(FILE *f, const void *data, size_t n, atomic_size_t *done) {
+        for (size_t off = 0; off < n; off += DB_WRITE_CHUNK) {
+                size_t len = n - off < DB_WRITE_CHUNK ? n - off : DB_WRITE_CHUNK;
+                if (fwrite((const uint8_t *)data + off, 1, len, f) != len) return 0;
+                if (done) atomic_fetch_add(done, len);
+        }
+        return 1;
+}
+
+int db_write(const char *fp, const Db_Entry *entries, size_t n, uint64_t seq, atomic_size_t *done) {
+        Char_Array strtab = dyn_array_empty(Char_Array);
+        U32_Array songs = dyn_array_empty(U32_Array);
+        Str_Map offsets = strmap_create(NULL, noop_free);
+        Db_Playlist *playlists = calloc(n ? n : 1, sizeof(Db_Playlist));
+        int ok = 0;
+
+        uint64_t songs_off = sizeof(Db_Header) + n * sizeof(Db_Playlist);
+        for (size_t i = 0; i < n; ++i) {
+                playlists[i].name = strtab_add(&strtab, &offsets, entries[i].name);
+                playlists[i].nsongs = entries[i].songfps->len;
+                playlists[i].songs = songs_off + songs.len * sizeof(uint32_t);
+                for (size_t j = 0; j < entries[i].songfps->len; ++j) {
+                        dyn_array_append(songs, strtab_add(&strtab, &offsets, entries[i].songfps->data[j]));
+                }
+                if (strtab.len > UINT32_MAX) {
+                        fprintf(stderr, "playlists are too big to be saved\n");
+                        goto done;
+                }
+        }
+
+        Db_Header hdr = {
+                .version = DB_VERSION,
+                .nplaylists = (uint32_t)n,
+                .strtab = songs_off + songs.len * sizeof(uint32_t),
+                .strtab_len = strtab.len,
+                .seq = seq,
+        };
+        memcpy(hdr.magic, DB_MAGIC, sizeof(hdr.magic));
+        hdr.size = hdr.strtab + hdr.strtab_len;
+
+        char tmpfp[4096];
+        snprintf(tmpfp, sizeof(tmpfp), "%s.tmp", fp);
+
+        FILE *f = fopen(tmpfp, "wb");
+        if (!f) {
+                perror("fopen");
+                goto done;
+        }
+
+        ok = write_chunked(f, &hdr, sizeof(hdr), done)
+                && write_chunked(f, playlists, n * sizeof(Db_Playlist), done)
+                && write_chunked(f, songs.data, songs.len * sizeof(uint32_t), done)
+                && write_chunked(f, strtab.data, strtab.len, done)
+                && fflush(f) == 0
+                && fsync(fileno(f)) == 0;
+        if (fclose(f) != 0) ok = 0;
+
+        if (!ok || rename(tmpfp, fp) == -1) {
+                perror("db_write");
+                (void)unlink(tmpfp);
+                ok = 0;
+        }
+
+done:
+        free(playlists);
+        dyn_array_free(songs);
+        dyn_array_free(strtab);
+        strmap_free(&offsets);
+        return ok;
+}
+
+//////////////////////////////////////////////////
+// Journal
+
+#define DB_JOURNAL_ALIGN 8
+
+static uint32_t       g_crc_table[256];
+static pthread_once_t g_crc_once = PTHREAD_ONCE_INIT;
+
+static void crc32_init(void) {
+        for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) {
+                        c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+                }
+                g_crc_table[i] = c;
+        }
+}
+
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t n) {
+        pthread_once(&g_crc_once, crc32_init);
+
+        const uint8_t *p = (const uint8_t *)data;
+        crc = ~crc;
+        for (size_t i = 0; i < n; ++i) {
+                crc = g_crc_table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+        }
+        return ~crc;
+}
+
+static uint32_t record_crc(const Db_Record_Header *h, const uint8_t *payload) {
+        Db_Record_Header tmp = *h;
+        tmp.crc = 0;
+        return crc32_update(crc32_update(0, &tmp, sizeof(tmp)), payload, h->len);
+}
+
+static size_t record_size(uint32_t len) {
+        size_t n = sizeof(Db_Record_Header) + len;
+        return (n + DB_JOURNAL_ALIGN-1) & ~(size_t)(DB_JOURNAL_ALIGN-1);
+}
+
+// Returns the offset of the record after the one at `off`,
+// or 0 if there is no complete record at `off`.
+static size_t record_next(const uint8_t *buf, size_t len, size_t off) {
+        if (len - off < sizeof(Db_Record_Header)) return 0;
+
+        Db_Record_Header h;
+        memcpy(&h, buf + off, sizeof(h));
+        const uint8_t *payload = buf + off + sizeof(h);
+
+        if (h.len == 0
+            || h.len > len - off - sizeof(h)
+            || record_size(h.len) > len - off
+            || payload[h.len-1] != '\0'
+            || h.crc != record_crc(&h, payload)) {
+                return 0;
+        }
+        return off + record_size(h.len);
+}
+
+int db_journal_open(const char *fp, Db_Journal *j) {
+        memset(j, 0, sizeof(Db_Journal));
+
+        int fd = open(fp, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return 0;
+
+        struct stat st;
+        if (fstat(fd, &st) == -1 || st.st_size < 8) {
+                close(fd);
+                return 0;
+        }
+
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+                perror("mmap");
+                return 0;
+        }
+        if (memcmp(map, DB_JOURNAL_MAGIC, 8)) {
+                munmap(map, st.st_size);
+                return 0;
+        }
+
+        j->map = (const uint8_t *)map;
+        j->maplen = st.st_size;
+
+        // Whatever comes after the last good record was cut short.
+        size_t off = 8, next;
+        while ((next = record_next(j->map, j->maplen, off)) != 0) {
+                off = next;
+        }
+        j->len = off;
+        j->pos = 8;
+        return 1;
+}
+
+void db_journal_close(Db_Journal *j) {
+        if (j->map) {
+                munmap((void *)j->map, j->maplen);
+        }
+        memset(j, 0, sizeof(Db_Journal));
+}
+
+int db_journal_next(Db_Journal *j, Db_Record *r) {
+        size_t end = j->len < j->maplen ? j->len : j->maplen;
+        if (j->pos >= end) return 0;
+
+        Db_Record_Header h;
+        memcpy(&h, j->map + j->pos, sizeof(h));
+        const char *payload = (const char *)j->map + j->pos + sizeof(h);
+        const char *payload_end = payload + h.len;
+        j->pos += record_size(h.len);
+
+        memset(r, 0, sizeof(Db_Record));
+        r->seq = h.seq;
+        r->op = (Db_Op)h.op;
+        r->name = payload;
+
+        const char *p = payload + strlen(payload) + 1;
+        if (r->op == DB_OP_RENAME) {
+                r->newname = p < payload_end ? p : "";
+        } else if (r->op == DB_OP_CREATE || r->op == DB_OP_REPLACE) {
+                // Only split up once somebody needs them.
+                r->songs = p;
+                r->songs_end = payload_end;
+        }
+
+        return 1;
+}
+
+void db_record_songs(const Db_Record *r, Str_Array *out) {
+        size_t n = 0;
+        for (const char *q = r->songs; q < r->songs_end; ++q) {
+                n += *q == '\0';
+        }
+        dyn_array_reserve(*out, out->len + n);
+
+        for (const char *p = r->songs; p < r->songs_end; p += strlen(p) + 1) {
+                out->data[out->len++] = (char *)p;
+        }
+}
@@ -15,10 +15,17 @@
 #include "ampire-display.h"
 #include "ampire-flag.h"
 #include "ampire-io.h"
+#include "ampire-intern.h"
+#include "ampire-m3u.h"
+#include "ampire-watch.h"
+#include "ampire-meta.h"
+#include "ampire-preload.h"
+#include "ampire-gapless.h"
 #include "ampire-utils.h"
 #include "ampire-ncurses-helpers.h"
 #include "ampire-global.h"
 #include "dyn_array.h"
+#include "dyn_hash.h"
 #include "ds/strmap.h"
 #include "ds/array.h"
 #include "config.h"
@@ -31,12 +38,17 @@ typedef enum {
         MAT_LOOP,
 } Music_Adv_Type;
 
+DYN_HASHMAP_TYPE(size_t, size_t, Size_T_Counts);
+
 typedef struct {
         size_t          uuid;
+        Playlist       *playlist;
         Str_Array      *songfps;
+        Arena          *arena;                   // Owns `pname`, the tags in `meta` and `prevsearch`
         char           *pname;                   // Playlist name
-        Str_Array       songnames;               // The stripped songname from the path
-        Size_T_Array    history_idxs;
+        Str_Array       songnames;               // Points to the songname inside of the path
+        Meta_Store      meta;                    // Tags of the songs, filled in from `g_meta`
+        Size_T_Deque    history_idxs;
         size_t          sel_songfps_index;
         size_t          scroll_offset;
         size_t          playlist_scroll_offset;
@@ -53,8 +65,12 @@ typedef struct {
         int             upnext_idx;              // The index of the next song to be played
         int             playlist_modified;       // Has the current playlist been modified?
         int             playlist_saved;
-        Size_T_Array    queue;                   // The 'next-up' songs
-        Size_T_Array    shuffle_queue;           // Queue for shuffling songs
+        Size_T_Deque    queue;                   // The 'next-up' songs
+        Size_T_Counts   queued;                  // How many times each song is in `queue`
+        Size_T_Deque    shuffle_queue;           // Queue for shuffling songs
+        Scan           *scan;                    // Background scan still adding to `songfps`, or NULL
+        size_t          scan_root;               // Which root of `scan` belongs to this playlist
+        int             loaded;                  // Saved playlists get their songs when first selected
 } Ctx;
 
 static int                   g_volume               = 68;
@@ -67,9 +83,21 @@ static volatile bool         g_need_next_song       = false;
 static int                   g_playlist_page        = 0;
 static int                   g_total_playlist_pages = 0;
 static int                   g_original_playlist_sz = 0;
+static Meta_Pipeline        *g_meta                 = NULL;
+static Preloader            *g_preload              = NULL;
+static Mix_Music            *g_playing_music        = NULL; // What the mixer has, of whichever playlist
 
 DYN_ARRAY_TYPE(Ctx, Ctx_Array);
 
+// A directory that showed up while watching, read in the background.
+typedef struct {
+        Scan *scan;
+        char *dir;
+        void *owner; // The `songfps` of the playlist it goes into
+} Tree_Scan;
+
+DYN_ARRAY_TYPE(Tree_Scan, Tree_Scan_Array);
+
 // Used for SDL function(s) with sig (*)(void) but
 // we still need to use the context. This should
 // be *always* set whenever the context switches!
@@ -80,6 +108,18 @@ static WINDOW *right_win; // Window for currently playing info
 
 static void pause_audio(Ctx *ctx);
 static void shuffle_song_idxs(Ctx *ctx);
+static ssize_t find_song(const Ctx *ctx, const char *path);
+
+// "Artist - Title" once the tags are known, the file name until then.
+static char *song_label(Ctx *ctx, size_t i) {
+        static char buf[512];
+        char *title = ctx->meta.titles.data[i];
+        char *artist = ctx->meta.artists.data[i];
+        if (!title) return ctx->songnames.data[i];
+        if (!artist) return title;
+        snprintf(buf, sizeof(buf), "%s - %s", artist, title);
+        return buf;
+}
 
 static void cleanup(void) {
         if ((g_config.flags & FT_ONESHOT) == 0) {
@@ -92,6 +132,9 @@ static void cleanup(void) {
         }
         Mix_HookMusicFinished(NULL);
         Mix_HaltMusic();
+        gapless_stop();
+        preload_free(g_preload);
+        g_preload = NULL;
         if (g_ctx && g_ctx->current_music) {
                 Mix_FreeMusic(g_ctx->current_music);
                 g_ctx->current_music = NULL;
@@ -148,10 +191,36 @@ static void format_time(int seconds, char *buf, size_t bufsize) {
         snprintf(buf, bufsize, "%02d:%02d", min, sec);
 }
 
+static void queued_add(Ctx *ctx, size_t idx) {
+        size_t *n = Size_T_Counts_get(&ctx->queued, idx);
+        if (n) ++*n;
+        else   Size_T_Counts_put(&ctx->queued, idx, 1);
+}
+
+static void queue_push(Ctx *ctx, size_t idx) {
+        dyn_deque_push_back(ctx->queue, idx);
+        queued_add(ctx, idx);
+}
+
+static void queue_pop(Ctx *ctx) {
+        size_t idx = dyn_deque_front(ctx->queue);
+        dyn_deque_pop_front(ctx->queue);
+        size_t *n = Size_T_Counts_get(&ctx->queued, idx);
+        if (n && --*n == 0) Size_T_Counts_remove(&ctx->queued, idx);
+}
+
+// After the indices in `queue` changed.
+static void queue_recount(Ctx *ctx) {
+        Size_T_Counts_clear(&ctx->queued);
+        for (size_t i = 0; i < ctx->queue.len; ++i) {
+                queued_add(ctx, dyn_deque_at(ctx->queue, i));
+        }
+}
+
 void handle_upnext(Ctx *ctx) {
         size_t r = 0;
         if (ctx->queue.len > 0) {
-                r = ctx->queue.data[0];
+                r = dyn_deque_front(ctx->queue);
         }
         else if (ctx->mat == MAT_NORMAL) {
                 r = (ctx->currently_playing_index + 1) % ctx->songfps->len;
@@ -160,21 +229,17 @@ void handle_upnext(Ctx *ctx) {
                 if (ctx->shuffle_queue.len == 0) {
                         shuffle_song_idxs(ctx);
                 }
-                r = ctx->shuffle_queue.data[0];
-                dyn_array_rm_at(ctx->shuffle_queue, 0);
+                r = dyn_deque_front(ctx->shuffle_queue);
+                dyn_deque_pop_front(ctx->shuffle_queue);
         } else {
                 r = ctx->currently_playing_index;
         }
         ctx->upnext_idx = r;
 }
 
-static void play_music(Ctx *ctx, const char *song) {
-        assert(song);
-        if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
-                fprintf(stderr, "SDL audio initialization failed: %s\n", SDL_GetError());
-                exit(1);
-        }
-
+// The device stays open for the whole session, songs are
+// only swapped in and out of the mixer.
+static void open_audio(void) {
         // Audio format to minimize ALSA adjustments
         SDL_AudioSpec desired = {
                 .freq = 44100,           // 44.1 kHz
@@ -198,35 +263,106 @@ static void play_music(Ctx *ctx, const char *song) {
         if (stderr != orig_stderr) fclose(stderr);
         stderr = orig_stderr;
 
+        // Without it every song is streamed, with a gap between them.
+        (void)gapless_init();
+}
+
+// Returns 0 if `song` could not be played, nothing is playing then.
+static int play_music(Ctx *ctx, const char *song) {
+        assert(song);
+
+        gapless_stop();
+
         // Free previous music if exists
         if (ctx->current_music) {
+                if (ctx->current_music == g_playing_music) g_playing_music = NULL;
                 Mix_FreeMusic(ctx->current_music);
                 ctx->current_music = NULL;
         }
 
         ctx->current_music = Mix_LoadMUS(song);
         if (!ctx->current_music) {
-                fprintf(stderr, "Failed to load music '%s': %s\n", song, Mix_GetError());
-                Mix_CloseAudio();
-                SDL_Quit();
-                exit(1);
+                return 0;
         }
 
         Mix_VolumeMusic(g_volume);
 
         // Play once to allow music_finished callback
         if (Mix_PlayMusic(ctx->current_music, 1) < 0) {
-                fprintf(stderr, "Failed to play music: %s\n", Mix_GetError());
                 Mix_FreeMusic(ctx->current_music);
                 ctx->current_music = NULL;
-                Mix_CloseAudio();
-                SDL_Quit();
-                exit(1);
+                return 0;
         }
+        g_playing_music = ctx->current_music;
+
+        return 1;
 }
 
 static void music_finished(void);
 
+// A song that was decoded already goes through the gapless player,
+// so that the songs after it follow without a gap.
+static void play_chunk(Ctx *ctx, const char *song, Mix_Chunk *chunk) {
+        // Stop whatever the mixer is playing, without going on to the next song.
+        Mix_HookMusicFinished(NULL);
+        Mix_HaltMusic();
+        Mix_HookMusicFinished(music_finished);
+        g_playing_music = NULL;
+
+        if (ctx->current_music) {
+                Mix_FreeMusic(ctx->current_music);
+                ctx->current_music = NULL;
+        }
+
+        gapless_volume(g_volume);
+        gapless_play(chunk, song);
+}
+
+// Is `ctx` the playlist the gapless player is playing from?
+static int ctx_owns_gapless(const Ctx *ctx) {
+        ssize_t cur = ctx->currently_playing_index;
+        return gapless_playing() && cur != -1 && (size_t)cur < ctx->songfps->len
+                && ctx->songfps->data[cur] == gapless_current();
+}
+
+// Have the up next song decoded, and queued right behind the
+// current one if that goes through the gapless player.
+static void sync_upnext(Ctx *ctx) {
+        const char *want = NULL;
+        if (ctx && ctx->sel_fst_song && ctx->currently_playing_index != -1
+            && (size_t)ctx->upnext_idx < ctx->songfps->len) {
+                want = ctx->songfps->data[ctx->upnext_idx];
+        }
+
+        const char *queued = gapless_queued();
+        if (queued && queued == want) return;
+        // Up next changed, do not play what was up next before.
+        if (queued) gapless_queue(NULL, NULL);
+        if (!want || !gapless_available()) return;
+
+        preload_request(g_preload, want, ctx->meta.durations.data[ctx->upnext_idx]);
+        if (ctx_owns_gapless(ctx)) {
+                Mix_Chunk *chunk = preload_take(g_preload, want);
+                if (chunk) gapless_queue(chunk, want);
+        }
+}
+
+// Everything that goes with a song starting, once it plays.
+static void song_started(Ctx *ctx, int notify) {
+        if (notify && (g_config.flags & FT_NOTIF)) {
+                tinyfd_notifyPopup("[ampire]: Up Next", song_label(ctx, ctx->currently_playing_index), "info");
+        }
+
+        ctx->start_ticks = SDL_GetTicks(); // Record start time
+        ctx->paused_ticks = 0;
+        ctx->pause_start = 0;
+
+        ctx->sel_fst_song = 1;
+
+        handle_upnext(ctx);
+        sync_upnext(ctx);
+}
+
 static void start_song(Ctx *ctx) {
         if (ctx->songfps->len == 0) {
                 return;
@@ -238,20 +374,46 @@ static void start_song(Ctx *ctx) {
 
         Mix_HookMusicFinished(music_finished);
         ctx->currently_playing_index = ctx->sel_songfps_index;
-        play_music(ctx, ctx->songfps->data[ctx->sel_songfps_index]);
         ctx->paused = 0;
 
-        if (g_config.flags & FT_NOTIF) {
-                tinyfd_notifyPopup("[ampire]: Up Next", ctx->songnames.data[ctx->sel_songfps_index], "info");
-        }
+        // Use the decoded song if it is the one that was up next,
+        // otherwise start streaming it right away.
+        const char *song = ctx->songfps->data[ctx->sel_songfps_index];
+        Mix_Chunk *chunk = preload_take(g_preload, song);
+        int ok = 1;
+        if (chunk) {
+                play_chunk(ctx, song, chunk);
+        } else if (!(ok = play_music(ctx, song))) {
+                // A song that cannot be played is skipped over with next,
+                // the playlist stays where it is.
+                char buf[256] = {0};
+                snprintf(buf, sizeof(buf), "Failed to play %s: %s",
+                         ctx->songnames.data[ctx->sel_songfps_index], Mix_GetError());
+                display_temp_message(buf);
+        }
+
+        song_started(ctx, ok);
+}
 
-        ctx->start_ticks = SDL_GetTicks(); // Record start time
-        ctx->paused_ticks = 0;
-        ctx->pause_start = 0;
+// Is the song about to end? The main loop waits for
+// input for less then, to start the next one sooner.
+// Songs in the gapless player go on by themselves.
+static int song_ending(const Ctx *ctx) {
+        if (!ctx || !ctx->current_music || ctx->paused) return 0;
+        double len = Mix_MusicDuration(ctx->current_music);
+        if (len <= 0) return 0;
+        double elapsed = (double)(SDL_GetTicks() - ctx->start_ticks - ctx->paused_ticks) / 1000.0;
+        return len - elapsed < 0.5;
+}
 
-        ctx->sel_fst_song = 1;
+// The song that was up next is the current one now.
+static void advance_song(Ctx *ctx) {
+        ctx->currently_playing_index = ctx->sel_songfps_index = ctx->upnext_idx;
+        dyn_deque_push_back(ctx->history_idxs, ctx->currently_playing_index);
 
-        handle_upnext(ctx);
+        if (ctx->queue.len > 0) {
+                queue_pop(ctx);
+        }
 }
 
 static void music_finished(void) {
@@ -267,17 +429,37 @@ static void music_finished(void) {
 
         assert(g_ctx);
 
-        g_ctx->currently_playing_index = g_ctx->sel_songfps_index = g_ctx->upnext_idx;
-        dyn_array_append(g_ctx->history_idxs, g_ctx->currently_playing_index);
-
-        if (g_ctx->queue.len > 0) {
-                dyn_array_rm_at(g_ctx->queue, 0);
-        }
+        advance_song(g_ctx);
 
         Mix_HaltMusic();
         g_need_next_song = true;
 }
 
+// The gapless player moved on to the next song by itself,
+// or ran out of songs.
+static void handle_gapless(Ctx *ctx) {
+        switch (gapless_poll()) {
+        case GAPLESS_NEXT: {
+                if (!ctx) break;
+                ssize_t idx = find_song(ctx, gapless_current());
+                if (idx == -1) {
+                        // Not in this playlist anymore.
+                        ctx->currently_playing_index = -1;
+                        break;
+                }
+                ctx->upnext_idx = idx;
+                advance_song(ctx);
+                song_started(ctx, 1);
+                ctx->start_ticks -= (Uint64)(gapless_position() * 1000);
+                adjust_scroll_offset(ctx);
+        } break;
+        case GAPLESS_END: {
+                if (ctx) music_finished();
+        } break;
+        case GAPLESS_NONE: break;
+        }
+}
+
 static void pause_audio(Ctx *ctx) {
         if (!ctx->sel_fst_song) return;
         ctx->paused = !ctx->paused;
@@ -292,7 +474,8 @@ static void pause_audio(Ctx *ctx) {
 }
 
 static void seek_music(Ctx *ctx, double seconds) {
-        if (ctx->currently_playing_index == -1 || !ctx->current_music || !ctx->sel_fst_song) {
+        int gapless = ctx_owns_gapless(ctx);
+        if (ctx->currently_playing_index == -1 || (!ctx->current_music && !gapless) || !ctx->sel_fst_song) {
                 return;
         }
 
@@ -309,7 +492,9 @@ static void seek_music(Ctx *ctx, double seconds) {
         }
 
         // Update playback
-        if (Mix_SetMusicPosition(new_position) < 0) {
+        if (gapless) {
+                gapless_seek(new_position);
+        } else if (Mix_SetMusicPosition(new_position) < 0) {
                 fprintf(stderr, "Failed to seek music: %s\n", Mix_GetError());
                 return;
         }
@@ -444,6 +629,31 @@ static void draw_currently_playing(Ctx *ctx, Ctx_Array *ctxs) {
 
         (void)iota(1);
 
+        if (ctx && ctx->scan) {
+                const char *spinner = "|/-\\";
+                wattron(right_win, A_DIM);
+                mvwprintw(right_win, iota(2), 1, "%c Scanning: %zu songs in %zu directories",
+                          spinner[(SDL_GetTicks() / 200) % 4], scan_nfiles(ctx->scan), scan_ndirs(ctx->scan));
+                if (scan_nbad(ctx->scan) > 0) {
+                        wprintw(right_win, " (%zu unplayable skipped)", scan_nbad(ctx->scan));
+                }
+                wattroff(right_win, A_DIM);
+        }
+
+        size_t save_done, save_total;
+        if (io_saving(&save_done, &save_total)) {
+                const int width = 20;
+                int filled = (int)(save_done * width / save_total);
+                wattron(right_win, A_DIM);
+                mvwprintw(right_win, iota(0), 1, "Saving: [");
+                for (int i = 0; i < width; ++i) {
+                        waddch(right_win, i < filled ? '#' : '.');
+                }
+                wprintw(right_win, "] %d%%", (int)(save_done * 100 / save_total));
+                (void)iota(2);
+                wattroff(right_win, A_DIM);
+        }
+
         // Display currently playing info in right window
         if (ctx && ctx->currently_playing_index != -1) {
                 // ... (unchanged code for "Now Playing", playlist info, etc.)
@@ -464,7 +674,10 @@ static void draw_currently_playing(Ctx *ctx, Ctx_Array *ctxs) {
                 wattroff(right_win, A_BOLD);
 
                 mvwprintw(right_win, iota(1), 1, "> Playlist: %s (%d tracks)", ctx->pname, ctx->numtracks);
-                mvwprintw(right_win, iota(1), 1, "> Current: %.*s", max_x - 2, shstr(ctx->songnames.data[ctx->currently_playing_index], max_x/2));
+                mvwprintw(right_win, iota(1), 1, "> Current: %.*s", max_x - 2, shstr(song_label(ctx, ctx->currently_playing_index), max_x/2));
+                if (ctx->meta.albums.data[ctx->currently_playing_index]) {
+                        mvwprintw(right_win, iota(1), 1, "> Album: %.*s", max_x - 2, shstr(ctx->meta.albums.data[ctx->currently_playing_index], max_x/2));
+                }
 
                 Uint64 current_ticks = SDL_GetTicks();
                 Uint64 elapsed_ms = ctx->paused ? (ctx->pause_start - ctx->start_ticks - ctx->paused_ticks)
@@ -478,6 +691,10 @@ static void draw_currently_playing(Ctx *ctx, Ctx_Array *ctxs) {
                         wattron(right_win, A_REVERSE | A_BLINK);
                         mvwprintw(right_win, iota(1), 1, "Paused");
                         wattroff(right_win, A_REVERSE | A_BLINK);
+                } else if (ctx->meta.durations.data[ctx->currently_playing_index] >= 0) {
+                        char len_str[16];
+                        format_time(ctx->meta.durations.data[ctx->currently_playing_index], len_str, sizeof(len_str));
+                        mvwprintw(right_win, iota(1), 1, "> Elapsed: %s / %s", time_str, len_str);
                 } else {
                         mvwprintw(right_win, iota(1), 1, "> Elapsed: %s", time_str);
                 }
@@ -530,12 +747,12 @@ static void draw_currently_playing(Ctx *ctx, Ctx_Array *ctxs) {
                                 } else {
                                         wattron(right_win, A_BOLD);
                                 }
-                                mvwprintw(right_win, iota(0)+j, 3, "| %s", shstr(ctx->songnames.data[ctx->history_idxs.data[i]], max_x/2));
+                                mvwprintw(right_win, iota(0)+j, 3, "| %s", shstr(song_label(ctx, dyn_deque_at(ctx->history_idxs, i)), max_x/2));
                                 if (!ctx->paused && i == ctx->history_idxs.len - 1) {
                                         const char *equalizer_frames[] = {"|   ", "||  ", "||| ", "||||"};
                                         int frame_count = sizeof(equalizer_frames) / sizeof(equalizer_frames[0]);
                                         int frame = (SDL_GetTicks() / 200) % frame_count;
-                                        int N = strlen(ctx->songnames.data[ctx->history_idxs.data[i]]);
+                                        int N = strlen(song_label(ctx, dyn_deque_at(ctx->history_idxs, i)));
                                         int loc = N > max_x/2 ? max_x/2 + 3 : N;
                                         mvwprintw(right_win, iota(0)+j, loc+6, "%s", equalizer_frames[frame]);
                                 }
@@ -547,7 +764,7 @@ static void draw_currently_playing(Ctx *ctx, Ctx_Array *ctxs) {
                         }
                         iota(ctx->history_idxs.len >= histsz ? histsz : ctx->history_idxs.len);
                         mvwprintw(right_win, iota(0), 1, "Up Next");
-                        mvwprintw(right_win, iota(1), strlen("Up Next")+1, ": [%s]", shstr(ctx->songnames.data[ctx->upnext_idx], max_x/2));
+                        mvwprintw(right_win, iota(1), strlen("Up Next")+1, ": [%s]", shstr(song_label(ctx, ctx->upnext_idx), max_x/2));
                 }
         } else {
                 if (ctx) {
@@ -583,15 +800,11 @@ static void draw_song_list(Ctx *ctx) {
                                 wattron(left_win, A_REVERSE);
                         }
                         // Print at x=1 to avoid left border, truncate to fit inside right border
-                        int is_in_queue = 0;
-                        for (size_t j = 0; j < ctx->queue.len; ++j) {
-                                if (ctx->queue.data[j] == i) {
-                                        mvwprintw(left_win, display_row, 1, "*");
-                                        is_in_queue = 1;
-                                        break;
-                                }
+                        int is_in_queue = Size_T_Counts_contains(&ctx->queued, i);
+                        if (is_in_queue) {
+                                mvwprintw(left_win, display_row, 1, "*");
                         }
-                        mvwprintw(left_win, display_row, 1+is_in_queue, "%.*s", max_x - 2, shstr(ctx->songnames.data[i], max_x/2 + 10));
+                        mvwprintw(left_win, display_row, 1+is_in_queue, "%.*s", max_x - 2, shstr(song_label(ctx, i), max_x/2 + 10));
                         if (i == ctx->sel_songfps_index) {
                                 wattroff(left_win, A_REVERSE);
                         }
@@ -599,7 +812,7 @@ static void draw_song_list(Ctx *ctx) {
                                 const char *equalizer_frames[] = {"|", "/", "-", "\\"};
                                 int frame_count = sizeof(equalizer_frames) / sizeof(equalizer_frames[0]);
                                 int frame = (SDL_GetTicks() / 200) % frame_count; // Cycle every 200ms
-                                int N = strlen(ctx->songnames.data[i]);
+                                int N = strlen(song_label(ctx, i));
                                 int loc = N > max_x/2 + 10 ? max_x/2 + 13 : N;
                                 mvwprintw(left_win, display_row, loc + 2, "%s", equalizer_frames[frame]);
                         }
@@ -670,16 +883,16 @@ static void shuffle_song_idxs(Ctx *ctx) {
         }
 
         for (size_t i = 0; i < ctx->numtracks; i++) {
-                dyn_array_append(ctx->shuffle_queue, i);
+                dyn_deque_push_back(ctx->shuffle_queue, i);
         }
 
         // Knuth shuffle
         for (int i = ctx->numtracks - 1; i > 0; i--) {
                 int j = rand() % (i + 1);
 
-                size_t temp                = ctx->shuffle_queue.data[i];
-                ctx->shuffle_queue.data[i] = ctx->shuffle_queue.data[j];
-                ctx->shuffle_queue.data[j] = temp;
+                size_t temp                         = dyn_deque_at(ctx->shuffle_queue, i);
+                dyn_deque_at(ctx->shuffle_queue, i) = dyn_deque_at(ctx->shuffle_queue, j);
+                dyn_deque_at(ctx->shuffle_queue, j) = temp;
         }
 }
 
@@ -699,10 +912,10 @@ static void handle_adv_type(Ctx *ctx) {
                 if (ctx->songfps->len != 0) {
                         ctx->sel_fst_song = 1;
                         shuffle_song_idxs(ctx);
-                        ctx->currently_playing_index = ctx->shuffle_queue.data[0];
-                        ctx->sel_songfps_index = ctx->shuffle_queue.data[0];
+                        ctx->currently_playing_index = dyn_deque_front(ctx->shuffle_queue);
+                        ctx->sel_songfps_index = dyn_deque_front(ctx->shuffle_queue);
                         start_song(ctx);
-                        dyn_array_append(ctx->history_idxs, ctx->currently_playing_index);
+                        dyn_deque_push_back(ctx->history_idxs, ctx->currently_playing_index);
                         adjust_scroll_offset(ctx);
                 }
         }
@@ -710,18 +923,25 @@ static void handle_adv_type(Ctx *ctx) {
 }
 
 static void handle_next_song(Ctx *ctx) {
-        if (!ctx || ctx->currently_playing_index == -1 || !ctx->current_music || !ctx->sel_fst_song) {
+        if (!ctx || ctx->currently_playing_index == -1 || !ctx->sel_fst_song) {
                 return;
         }
 
-        Mix_HaltMusic();
+        // Halting calls music_finished(), unless the song never
+        // started because it could not be loaded. The gapless player
+        // goes straight to the song it has queued, if it has one.
+        if (ctx->current_music) {
+                Mix_HaltMusic();
+        } else if (!gapless_skip()) {
+                music_finished();
+        }
 
         // Adjust scroll offset to keep selection visible
         adjust_scroll_offset(ctx);
 }
 
 static void handle_prev_song(Ctx *ctx) {
-        if (!ctx || ctx->currently_playing_index == -1 || !ctx->current_music || !ctx->sel_fst_song) {
+        if (!ctx || ctx->currently_playing_index == -1 || !ctx->sel_fst_song) {
                 return;
         }
 
@@ -733,14 +953,14 @@ static void handle_prev_song(Ctx *ctx) {
         if (time_played > 1 || ctx->history_idxs.len <= 1) {
                 // Restart current song
                 int old_upnext = ctx->upnext_idx;
-                ctx->sel_songfps_index = ctx->currently_playing_index = dyn_array_at(ctx->history_idxs, ctx->history_idxs.len - 1);
+                ctx->sel_songfps_index = ctx->currently_playing_index = dyn_deque_back(ctx->history_idxs);
                 start_song(ctx);
                 ctx->upnext_idx = old_upnext;
         } else if (ctx->history_idxs.len > 1) {
                 // Play previous song from history
-                ctx->sel_songfps_index = ctx->currently_playing_index = dyn_array_at(ctx->history_idxs, ctx->history_idxs.len - 2);
+                ctx->sel_songfps_index = ctx->currently_playing_index = dyn_deque_at(ctx->history_idxs, ctx->history_idxs.len - 2);
                 start_song(ctx);
-                dyn_array_rm_at(ctx->history_idxs, ctx->history_idxs.len - 1);
+                dyn_deque_pop_back(ctx->history_idxs);
         }
 
         adjust_scroll_offset(ctx);
@@ -829,9 +1049,10 @@ static void handle_search(Ctx *ctx, size_t startfrom, int rev, char *prevsearch)
         if (prevsearch) {
                 query = prevsearch;
         } else {
-                query = get_userin("Entery Query (RegEx Supported):", NULL);
-                if (!query) return;
-                ctx->prevsearch = strdup(query);
+                char *in = get_userin("Entery Query (RegEx Supported):", NULL);
+                if (!in) return;
+                ctx->prevsearch = query = arena_strdup(ctx->arena, in);
+                free(in);
         }
         ssize_t found = -1;
         if (rev) {
@@ -864,10 +1085,13 @@ static Ctx ctx_create(Playlist *p) {
         static size_t uuid = 0;
         Ctx ctx = (Ctx) {
                 .uuid                    = uuid++,
+                .playlist                = p,
                 .songfps                 = &p->songfps,
+                .arena                   = p->arena,
                 .pname                   = p->name,
-                .history_idxs            = dyn_array_empty(Size_T_Array),
+                .history_idxs            = dyn_deque_empty(Size_T_Deque),
                 .songnames               = dyn_array_empty(Str_Array),
+                .meta                    = meta_store_create(),
                 .sel_songfps_index       = 0,
                 .scroll_offset           = 0,
                 .playlist_scroll_offset  = 0,
@@ -884,16 +1108,90 @@ static Ctx ctx_create(Playlist *p) {
                 .upnext_idx              = 0,
                 .playlist_modified       = 0,
                 .playlist_saved          = 0,
-                .queue                   = dyn_array_empty(Size_T_Array),
-                .shuffle_queue           = dyn_array_empty(Size_T_Array),
+                .queue                   = dyn_deque_empty(Size_T_Deque),
+                .queued                  = dyn_hash_empty(Size_T_Counts),
+                .shuffle_queue           = dyn_deque_empty(Size_T_Deque),
+                .scan                    = p->scan,
+                .scan_root               = p->scan_root,
+                .loaded                  = p->loaded,
         };
         for (size_t i = 0; i < p->songfps.len; ++i) {
-                dyn_array_append(ctx.songnames,
-                                 strdup(get_song_name(ctx.songfps->data[i])));
+                dyn_array_append(ctx.songnames, get_song_name(ctx.songfps->data[i]));
+                meta_store_append(&ctx.meta);
         }
         return ctx;
 }
 
+static void ctx_load(Ctx *ctx) {
+        if (ctx->loaded) return;
+        ctx->loaded = 1;
+
+        io_load_playlist(ctx->playlist);
+        ctx->numtracks = ctx->songfps->len;
+        for (size_t i = 0; i < ctx->songfps->len; ++i) {
+                dyn_array_append(ctx->songnames, get_song_name(ctx->songfps->data[i]));
+                meta_store_append(&ctx->meta);
+        }
+        if (g_meta) {
+                meta_request(g_meta, ctx->songfps, ctx->songfps, 0);
+        }
+}
+
+// Give back everything the playlist has, all of its strings go
+// with the arena. The songs are interned, they only go once
+// nothing else holds them either.
+static void ctx_free(Ctx *ctx) {
+        if (ctx->current_music) {
+                // Other playlists can hold on to a song that is not
+                // playing anymore, that one can just go.
+                if (ctx->current_music == g_playing_music) {
+                        // Do not go on to the next song of a playlist that is gone.
+                        Mix_HookMusicFinished(NULL);
+                        Mix_HaltMusic();
+                        g_playing_music = NULL;
+                }
+                Mix_FreeMusic(ctx->current_music);
+                ctx->current_music = NULL;
+        }
+        if (ctx_owns_gapless(ctx)) {
+                gapless_stop();
+        }
+
+        intern_unref_all(ctx->songfps);
+        dyn_array_free(*ctx->songfps);
+        *ctx->songfps = dyn_array_empty(Str_Array);
+        dyn_array_free(ctx->songnames);
+        meta_store_free(&ctx->meta);
+        dyn_deque_free(ctx->history_idxs);
+        dyn_deque_free(ctx->queue);
+        dyn_deque_free(ctx->shuffle_queue);
+        Size_T_Counts_free(&ctx->queued);
+        arena_free(ctx->arena);
+
+        ctx->playlist->arena = NULL;
+        ctx->playlist->name = NULL;
+        ctx->arena = NULL;
+        ctx->pname = NULL;
+        ctx->prevsearch = NULL;
+}
+
+static void ctxs_free(Ctx_Array *ctxs) {
+        Mix_HookMusicFinished(NULL);
+        Mix_HaltMusic();
+        gapless_stop();
+        for (size_t i = 0; i < ctxs->len; ++i) {
+                ctx_free(&ctxs->data[i]);
+        }
+        dyn_array_free(*ctxs);
+        g_ctx = NULL;
+}
+
+// Switch to playlist `i`, reading its songs if this is the first time.
+static Ctx *ctx_select(Ctx_Array *ctxs, size_t i) {
+        ctx_load(&ctxs->data[i]);
+        return &ctxs->data[i];
+}
+
 static void save_playlist(Ctx *ctx) {
         if (!ctx) return;
         char *name = NULL;
@@ -912,19 +1210,43 @@ static void save_playlist(Ctx *ctx) {
                 } else {
                         break;
                 }
+                free(name);
         }
 
         if (ctx->playlist_saved) {
                 io_replace_playlist_songs(ctx->pname, ctx->songfps);
         } else {
                 io_write_to_config_file(name, ctx->songfps);
-                ctx->pname = name;
+                ctx->pname = arena_strdup(ctx->arena, name);
+                free(name);
         }
 
         ctx->playlist_modified = 0;
         ctx->playlist_saved = 1;
 }
 
+static void export_playlist(Ctx *ctx) {
+        if (!ctx) return;
+
+        char autofill[256];
+        snprintf(autofill, sizeof(autofill), "%s.m3u8", get_song_name(ctx->pname));
+        char *fp = get_userin("Export to (.m3u, .m3u8 or .pls):", autofill);
+        if (!fp) return;
+        if (!strcmp(fp, "")) {
+                free(fp);
+                return;
+        }
+
+        char msg[512];
+        if (m3u_write(fp, ctx->songfps)) {
+                snprintf(msg, sizeof(msg), "Exported %zu songs to %s", ctx->songfps->len, fp);
+        } else {
+                snprintf(msg, sizeof(msg), "Failed to export to %s", fp);
+        }
+        display_temp_message(msg);
+        free(fp);
+}
+
 static void volume_up(Ctx *ctx) {
         if (!ctx) return;
         g_volume += 10;
@@ -932,6 +1254,7 @@ static void volume_up(Ctx *ctx) {
                 g_volume = MIX_MAX_VOLUME;
         }
         Mix_VolumeMusic(g_volume);
+        gapless_volume(g_volume);
 }
 
 static void volume_down(Ctx *ctx) {
@@ -941,6 +1264,7 @@ static void volume_down(Ctx *ctx) {
                 g_volume = 0;
         }
         Mix_VolumeMusic(g_volume);
+        gapless_volume(g_volume);
 }
 
 static void handle_mute(void) {
@@ -951,67 +1275,398 @@ static void handle_mute(void) {
                 g_volume = 0;
         }
         Mix_VolumeMusic(g_volume);
+        gapless_volume(g_volume);
+}
+
+// Drop the removed songs from a queue of song indices
+// and move the rest to where they are now.
+static void remap_song_idxs(Size_T_Deque *dq, const uint8_t *rm, const size_t *to) {
+        size_t len = 0;
+        for (size_t i = 0; i < dq->len; ++i) {
+                size_t it = dyn_deque_at(*dq, i);
+                if (rm[it]) continue;
+                dyn_deque_at(*dq, len++) = to[it];
+        }
+        dq->len = len;
+}
+
+static ssize_t find_song(const Ctx *ctx, const char *path) {
+        const char *song = intern_find(path);
+        if (!song) return -1;
+        for (size_t i = 0; i < ctx->songfps->len; ++i) {
+                if (ctx->songfps->data[i] == song) return i;
+        }
+        return -1;
+}
+
+// New songs go to the end so that no index in use has to change.
+// Takes over a reference to the interned `path`.
+static void append_song(Ctx *ctx, char *path) {
+        dyn_array_append(*ctx->songfps, path);
+        dyn_array_append(ctx->songnames, get_song_name(path));
+        meta_store_append(&ctx->meta);
+        size_t idx = ctx->numtracks++;
+
+        // Give it a random spot in what is left of the shuffle.
+        if (ctx->mat == MAT_SHUFFLE && ctx->shuffle_queue.len > 0) {
+                size_t j = rand() % (ctx->shuffle_queue.len + 1);
+                dyn_deque_push_back(ctx->shuffle_queue, idx);
+                dyn_deque_back(ctx->shuffle_queue) = dyn_deque_at(ctx->shuffle_queue, j);
+                dyn_deque_at(ctx->shuffle_queue, j) = idx;
+        }
+}
+
+static void add_song(Ctx *ctx, const char *path) {
+        if (find_song(ctx, path) == -1) {
+                append_song(ctx, intern(path));
+                meta_request(g_meta, ctx->songfps, ctx->songfps, ctx->songfps->len-1);
+        }
+}
+
+// Remove every song `i` with `rm[i]` set, in one pass over
+// the playlist however many there are.
+static void rm_songs(Ctx *ctx, const uint8_t *rm) {
+        size_t n = ctx->songfps->len;
+
+        // The new index of every song that stays. For the ones
+        // that go, the index of the first song after them.
+        size_t *to = malloc((n + 1) * sizeof(size_t));
+        size_t kept = 0;
+        for (size_t i = 0; i < n; ++i) {
+                to[i] = kept;
+                kept += !rm[i];
+        }
+        to[n] = kept;
+        if (kept == n) {
+                free(to);
+                return;
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+                if (rm[i]) intern_unref(ctx->songfps->data[i]);
+        }
+        dyn_array_filter(*ctx->songfps, i, !rm[i]);
+        dyn_array_filter(ctx->songnames, i, !rm[i]);
+        meta_store_filter(&ctx->meta, rm);
+        ctx->numtracks -= n - kept;
+
+        remap_song_idxs(&ctx->queue, rm, to);
+        queue_recount(ctx);
+        remap_song_idxs(&ctx->shuffle_queue, rm, to);
+        remap_song_idxs(&ctx->history_idxs, rm, to);
+
+        // The song keeps playing, but it is not in the playlist anymore.
+        ssize_t cur = ctx->currently_playing_index;
+        if (cur != -1 && (size_t)cur < n) {
+                ctx->currently_playing_index = rm[cur] ? -1 : (ssize_t)to[cur];
+        }
+
+        // The selection stays where it is, on the song that took its place.
+        size_t sel = to[ctx->sel_songfps_index < n ? ctx->sel_songfps_index : n];
+        ctx->sel_songfps_index = sel < kept ? sel : (kept > 0 ? kept - 1 : 0);
+
+        size_t next = (size_t)ctx->upnext_idx;
+        if (kept == 0) {
+                ctx->upnext_idx = 0;
+        } else if (next < n && rm[next]) {
+                handle_upnext(ctx);
+        } else if (next < n) {
+                ctx->upnext_idx = to[next];
+        }
+
+        free(to);
+}
+
+static void rm_song(Ctx *ctx, size_t idx) {
+        uint8_t *rm = calloc(ctx->songfps->len, 1);
+        rm[idx] = 1;
+        rm_songs(ctx, rm);
+        free(rm);
+}
+
+static void noop_free(uint8_t *v) {
+        (void)v;
 }
 
 static void remove_duplicates(Ctx *ctx) {
         if (!prompt_yes_no("Remove duplicate tracks in playlist?")) return;
 
-        Str_Array found = dyn_array_empty(Str_Array);
-        Str_Array tmp = dyn_array_empty(Str_Array);
-        Size_T_Array idxs = dyn_array_empty(Size_T_Array);
+        uint8_t *rm = calloc(ctx->songnames.len, 1);
+        Str_Map seen = strmap_create(NULL, noop_free);
+        size_t found = 0;
 
         // Find duplicates
         for (size_t i = 0; i < ctx->songnames.len; ++i) {
-                int is_duplicate = 0;
-                for (size_t j = 0; j < tmp.len; ++j) {
-                        if (!strcmp(ctx->songnames.data[i], tmp.data[j])) {
-                                is_duplicate = 1;
-                                break;
-                        }
-                }
-                if (is_duplicate) {
+                if (strmap_contains(&seen, ctx->songnames.data[i])) {
                         char buf[256] = {0};
-                        sprintf(buf, "Duplicate: %s", ctx->songnames.data[i]);
+                        snprintf(buf, sizeof(buf), "Duplicate: %s", ctx->songnames.data[i]);
                         display_temp_message_wsleep(buf, -1);
-                        dyn_array_append(found, ctx->songnames.data[i]);
-                        dyn_array_append(idxs, i); // Collect index of duplicate
+                        rm[i] = 1;
+                        ++found;
                 } else {
-                        dyn_array_append(tmp, ctx->songnames.data[i]);
+                        strmap_insert(&seen, ctx->songnames.data[i], (uint8_t *)1);
                 }
         }
 
-        if (!found.len) {
+        if (!found) {
                 display_temp_message("No duplicates found");
                 goto cleanup;
         }
 
-        // Sort indices to avoid index shifting issues
-        for (size_t i = 0; i < idxs.len; ++i) {
-                for (size_t j = i + 1; j < idxs.len; ++j) {
-                        if (idxs.data[i] < idxs.data[j]) {
-                                size_t temp = idxs.data[i];
-                                idxs.data[i] = idxs.data[j];
-                                idxs.data[j] = temp;
+        rm_songs(ctx, rm);
+
+        char buf[256] = {0};
+        sprintf(buf, "Removed %zu tracks", found);
+        display_temp_message(buf);
+        ctx->playlist_modified = 1;
+
+ cleanup:
+        free(rm);
+        strmap_free(&seen);
+}
+
+// Takes over a reference to the interned `path`.
+static void rename_song(Ctx *ctx, size_t idx, char *path) {
+        intern_unref(ctx->songfps->data[idx]);
+        ctx->songfps->data[idx] = path;
+        ctx->songnames.data[idx] = get_song_name(path);
+}
+
+static Ctx *ctx_from_owner(Ctx_Array *ctxs, void *owner) {
+        for (size_t i = 0; i < ctxs->len; ++i) {
+                if (ctxs->data[i].songfps == owner) return &ctxs->data[i];
+        }
+        return NULL;
+}
+
+static int is_below(const char *path, const char *dir) {
+        size_t n = strlen(dir);
+        return !strncmp(path, dir, n) && path[n] == '/';
+}
+
+// Takes ownership of `dir`.
+static void tree_scan_start(Tree_Scan_Array *trees, char *dir, void *owner) {
+        Str_Array roots = dyn_array_empty(Str_Array);
+        dyn_array_append(roots, dir);
+        dyn_array_append(*trees, ((Tree_Scan) {
+                .scan = scan_start(&roots, NULL),
+                .dir = dir,
+                .owner = owner,
+        }));
+        dyn_array_free(roots);
+}
+
+// The directory `from` is gone, or at `to` now if that is not NULL.
+// Scans below it start over at the new place.
+static void tree_scans_move(Tree_Scan_Array *trees, void *owner, const char *from, const char *to) {
+        size_t n = trees->len;
+        for (size_t i = 0; i < n;) {
+                Tree_Scan t = trees->data[i];
+                if (t.owner != owner || (strcmp(t.dir, from) && !is_below(t.dir, from))) {
+                        ++i;
+                        continue;
+                }
+                scan_free(t.scan);
+                dyn_array_rm_at(*trees, i);
+                --n;
+                if (to) {
+                        const char *rest = t.dir + strlen(from);
+                        size_t tn = strlen(to), rn = strlen(rest);
+                        char *dir = malloc(tn + rn + 1);
+                        memcpy(dir, to, tn);
+                        memcpy(dir+tn, rest, rn+1);
+                        tree_scan_start(trees, dir, owner);
+                }
+                free(t.dir);
+        }
+}
+
+// Watch the directories a scan went through. What was created in one of
+// them after the scan read it but before the watch was there would be
+// missed, so each one is looked at again. New subdirectories get a scan
+// of their own.
+static void watch_scanned(Ctx *ctx, Watcher *w, Tree_Scan_Array *trees, Scan *s, Scan_Dir_Array *dirs) {
+        Str_Array found = dyn_array_empty(Str_Array);
+        Str_Array subdirs = dyn_array_empty(Str_Array);
+
+        for (size_t i = 0; i < dirs->len; ++i) {
+                if (watch_add(w, dirs->data[i].path, ctx->songfps)) {
+                        scan_recheck(s, &dirs->data[i], 1, &found, &subdirs);
+                }
+                free(dirs->data[i].path);
+        }
+
+        for (size_t i = 0; i < found.len; ++i) {
+                add_song(ctx, found.data[i]);
+                intern_unref(found.data[i]);
+        }
+        for (size_t i = 0; i < subdirs.len; ++i) {
+                tree_scan_start(trees, subdirs.data[i], ctx->songfps);
+        }
+
+        dyn_array_free(found);
+        dyn_array_free(subdirs);
+}
+
+static void handle_watch_event(Ctx *ctx, Tree_Scan_Array *trees, Watch_Event *ev) {
+        switch (ev->kind) {
+        case WATCH_ADD: {
+                add_song(ctx, ev->path);
+        } break;
+        case WATCH_REMOVE: {
+                ssize_t idx = find_song(ctx, ev->path);
+                if (idx != -1) rm_song(ctx, idx);
+        } break;
+        case WATCH_RENAME: {
+                ssize_t idx = find_song(ctx, ev->path);
+                if (idx != -1) {
+                        rename_song(ctx, idx, intern(ev->newpath));
+                } else {
+                        add_song(ctx, ev->newpath);
+                }
+        } break;
+        case WATCH_REMOVE_DIR: {
+                tree_scans_move(trees, ctx->songfps, ev->path, NULL);
+                uint8_t *rm = malloc(ctx->songfps->len + 1);
+                for (size_t i = 0; i < ctx->songfps->len; ++i) {
+                        rm[i] = is_below(ctx->songfps->data[i], ev->path);
+                }
+                rm_songs(ctx, rm);
+                free(rm);
+        } break;
+        case WATCH_RENAME_DIR: {
+                tree_scans_move(trees, ctx->songfps, ev->path, ev->newpath);
+                size_t fn = strlen(ev->path);
+                for (size_t i = 0; i < ctx->songfps->len; ++i) {
+                        const char *old = ctx->songfps->data[i];
+                        if (!is_below(old, ev->path)) continue;
+                        rename_song(ctx, i, intern_path(ev->newpath, old+fn+1));
+                }
+        } break;
+        case WATCH_ADD_DIR: {
+                tree_scan_start(trees, ev->path, ctx->songfps);
+                ev->path = NULL;
+        } break;
+        default: assert(0 && "unreachable");
+        }
+
+        if (ctx->playlist_saved) {
+                ctx->playlist_modified = 1;
+        }
+}
+
+// Apply changes on disk to the playlists they belong to.
+static void handle_watch(Watcher *w, Ctx_Array *ctxs, Tree_Scan_Array *trees) {
+        Watch_Event_Array evs = dyn_array_empty(Watch_Event_Array);
+        watch_poll(w, &evs);
+
+        for (size_t i = 0; i < evs.len; ++i) {
+                Ctx *ctx = ctx_from_owner(ctxs, evs.data[i].owner);
+                if (ctx) {
+                        handle_watch_event(ctx, trees, &evs.data[i]);
+                        if (ctx == g_ctx) adjust_scroll_offset(ctx);
+                }
+                free(evs.data[i].path);
+                free(evs.data[i].newpath);
+        }
+
+        dyn_array_free(evs);
+}
+
+// Same as handle_scan(), for the directories that showed up while
+// watching. Playlists that were deleted in the meantime get nothing.
+static void handle_tree_scans(Tree_Scan_Array *trees, Ctx_Array *ctxs, Watcher *w) {
+        for (size_t i = 0; i < trees->len;) {
+                Tree_Scan t = trees->data[i];
+                Ctx *ctx = ctx_from_owner(ctxs, t.owner);
+                Str_Array found = dyn_array_empty(Str_Array);
+                Scan_Dir_Array dirs = dyn_array_empty(Scan_Dir_Array);
+                int done = scan_drain(t.scan, 0, 1, &found, &dirs);
+
+                if (ctx) {
+                        size_t len = ctx->songfps->len;
+                        for (size_t j = 0; j < found.len; ++j) {
+                                add_song(ctx, found.data[j]);
                         }
+                        // Might add to `trees`, which is fine, `t` is a copy.
+                        watch_scanned(ctx, w, trees, t.scan, &dirs);
+                        if (ctx->songfps->len != len && ctx->playlist_saved) {
+                                ctx->playlist_modified = 1;
+                        }
+                        if (ctx == g_ctx) adjust_scroll_offset(ctx);
+                } else {
+                        for (size_t j = 0; j < dirs.len; ++j) {
+                                free(dirs.data[j].path);
+                        }
+                }
+                intern_unref_all(&found);
+
+                if (done) {
+                        scan_free(t.scan);
+                        free(t.dir);
+                        dyn_array_rm_at(*trees, i);
+                } else {
+                        ++i;
                 }
+
+                dyn_array_free(found);
+                dyn_array_free(dirs);
+        }
+}
+
+// Move what the background scan has found since the last tick into
+// the playlist. Directories are watched once they are handed out, see
+// watch_scanned() for what changed in them since the scan read them.
+static void handle_scan(Ctx *ctx, Watcher *w, Tree_Scan_Array *trees) {
+        if (!ctx->scan) return;
+
+        Str_Array found = dyn_array_empty(Str_Array);
+        Scan_Dir_Array dirs = dyn_array_empty(Scan_Dir_Array);
+        int done = scan_drain(ctx->scan, ctx->scan_root, 1, &found, w->fd != -1 ? &dirs : NULL);
+
+        size_t first = ctx->songfps->len;
+        for (size_t i = 0; i < found.len; ++i) {
+                append_song(ctx, found.data[i]);
         }
+        meta_request(g_meta, ctx->songfps, ctx->songfps, first);
+        watch_scanned(ctx, w, trees, ctx->scan, &dirs);
 
-        // Remove duplicates from songfps and songnames
-        for (size_t i = 0; i < idxs.len; ++i) {
-                dyn_array_rm_at(*ctx->songfps, idxs.data[i]);
-                dyn_array_rm_at(ctx->songnames, idxs.data[i]);
-                --ctx->numtracks;
+        // The last song was wrapping around to the first one,
+        // but now there is something after it.
+        if (found.len > 0 && ctx->mat == MAT_NORMAL && ctx->queue.len == 0
+            && ctx->currently_playing_index != -1) {
+                handle_upnext(ctx);
         }
 
-        char buf[256] = {0};
-        sprintf(buf, "Removed %zu tracks", idxs.len);
-        display_temp_message(buf);
-        ctx->playlist_modified = 1;
+        if (done) {
+                ctx->scan = NULL;
+        }
 
- cleanup:
         dyn_array_free(found);
-        dyn_array_free(tmp);
-        dyn_array_free(idxs);
+        dyn_array_free(dirs);
+}
+
+// Put the tags that were read since the last tick where they belong.
+static void handle_meta(Ctx_Array *ctxs) {
+        Meta_Result_Array res = dyn_array_empty(Meta_Result_Array);
+        meta_poll(g_meta, &res);
+
+        for (size_t i = 0; i < res.len; ++i) {
+                Meta_Result *r = &res.data[i];
+                Ctx *ctx = ctx_from_owner(ctxs, r->owner);
+                if (ctx && ctx->songfps->len > 0) {
+                        // Songs before it may have been removed since.
+                        size_t j = r->idx < ctx->songfps->len ? r->idx : ctx->songfps->len-1;
+                        for (; j > 0 && ctx->songfps->data[j] != r->path; --j);
+                        if (ctx->songfps->data[j] == r->path) {
+                                meta_store_set(&ctx->meta, j, &r->meta, ctx->arena);
+                        }
+                }
+                intern_unref(r->path);
+                meta_clear(&r->meta);
+        }
+
+        dyn_array_free(res);
 }
 
 static void handle_oneshot_sigint(int sig) {
@@ -1039,7 +1694,6 @@ void run(const Playlist_Array *playlists) {
                         ctxs.data[ctxs.len-1].playlist_saved = 1;
                 }
         }
-        g_ctx = &ctxs.data[0];
 
         if (g_config.volume != -1) {
                 g_volume = g_config.volume;
@@ -1050,9 +1704,11 @@ void run(const Playlist_Array *playlists) {
                         err_wargs("playlist %d is out of range of %zu", g_config.playlist, ctxs.len);
                 }
                 ctx_idx = g_config.playlist-1;
-                g_ctx = &ctxs.data[ctx_idx];
         }
 
+        // Only the playlist that is shown first gets loaded.
+        g_ctx = ctxs.len > 0 ? ctx_select(&ctxs, ctx_idx) : NULL;
+
         g_total_playlist_pages = (int)ceilf(((float)ctxs.len) / ((float)g_config.playlist_sz));
 
         SDL_SetLogPriorities(SDL_LOG_PRIORITY_ERROR);
@@ -1061,6 +1717,7 @@ void run(const Playlist_Array *playlists) {
                 fprintf(stderr, "SDL could not initialize: %s\n", SDL_GetError());
                 exit(1);
         }
+        open_audio();
 
         atexit(cleanup);
 
@@ -1068,27 +1725,86 @@ void run(const Playlist_Array *playlists) {
                 // --oneshot,-o mode, not using ncurses and the TUI.
                 const char *fp = playlists->data[playlists->len-1].songfps.data[0];
                 signal(SIGINT, handle_oneshot_sigint);
-                play_music(g_ctx, fp);
-                while (g_oneshot_keep_running);
+                if (play_music(g_ctx, fp)) {
+                        while (g_oneshot_keep_running);
+                } else {
+                        fprintf(stderr, "Failed to load music '%s': %s\n", fp, Mix_GetError());
+                }
+                ctxs_free(&ctxs);
                 return;
         }
 
         init_ncurses();
         signal(SIGWINCH, resize_signal_handler);
 
+        g_meta = meta_pipeline_create();
+        g_preload = preload_create();
+        for (size_t i = 0; i < ctxs.len; ++i) {
+                if (ctxs.data[i].loaded) {
+                        meta_request(g_meta, ctxs.data[i].songfps, ctxs.data[i].songfps, 0);
+                }
+        }
+
+        // Every playlist from the command line shares the same scan.
+        Scan *scan = NULL;
+        for (size_t i = 0; i < playlists->len && !scan; ++i) {
+                scan = playlists->data[i].scan;
+        }
+
+        Watcher watcher = { .fd = -1 };
+        Tree_Scan_Array trees = dyn_array_empty(Tree_Scan_Array);
+        int watch_warned = 0;
+        if (g_config.flags & FT_WATCH) {
+                (void)watch_init(&watcher);
+        }
+
         int ch;
         while (1) {
         start:
                 handle_resize();
                 draw_windows(g_ctx, &ctxs);
+                timeout(song_ending(g_ctx) ? 5 : 100);
                 ch = getch();
 
+                handle_gapless(g_ctx);
+
                 if (g_need_next_song) {
                         g_need_next_song = false;
                         start_song(g_ctx);
                         adjust_scroll_offset(g_ctx);
                 }
 
+                sync_upnext(g_ctx);
+
+                if (scan) {
+                        int scanning = 0;
+                        for (size_t i = 0; i < ctxs.len; ++i) {
+                                handle_scan(&ctxs.data[i], &watcher, &trees);
+                                scanning |= ctxs.data[i].scan != NULL;
+                        }
+                        // Everything was handed out, the tree
+                        // the scan kept around can go now.
+                        if (!scanning && scan_finished(scan)) {
+                                scan_free(scan);
+                                scan = NULL;
+                        }
+                }
+
+                handle_meta(&ctxs);
+
+                if (io_save_failed()) {
+                        display_temp_message("Failed to save playlists!");
+                }
+
+                if (watcher.fd != -1) {
+                        handle_watch(&watcher, &ctxs, &trees);
+                        handle_tree_scans(&trees, &ctxs, &watcher);
+                        if (watcher.full && !watch_warned) {
+                                display_temp_message("Not all directories can be watched, raise fs.inotify.max_user_watches");
+                                watch_warned = 1;
+                        }
+                }
+
                 // TODO: enable this feature again.
                 // it currently is bugged when you use it
                 // and it goes out of the scope of the
@@ -1128,7 +1844,7 @@ void run(const Playlist_Array *playlists) {
                 } break;
                 case 'J': {
                         if (ctx_idx < ctxs.len-1) {
-                                g_ctx = &ctxs.data[++ctx_idx];
+                                g_ctx = ctx_select(&ctxs, ++ctx_idx);
                                 if (ctx_idx % g_config.playlist_sz == 0) {
                                         ++g_playlist_page;
                                 }
@@ -1139,7 +1855,7 @@ void run(const Playlist_Array *playlists) {
                                 if (ctx_idx % g_config.playlist_sz == 0) {
                                         --g_playlist_page;
                                 }
-                                g_ctx = &ctxs.data[--ctx_idx];
+                                g_ctx = ctx_select(&ctxs, --ctx_idx);
                         }
                 } break;
                 case 'j':
@@ -1195,30 +1911,42 @@ void run(const Playlist_Array *playlists) {
                         volume_up(g_ctx);
                 } break;
                 case 'u': {
-                        dyn_array_append(g_ctx->queue, g_ctx->sel_songfps_index);
+                        queue_push(g_ctx, g_ctx->sel_songfps_index);
                         handle_upnext(g_ctx);
                 } break;
                 case '[': {
                         if (g_playlist_page > 0) {
                                 --g_playlist_page;
                                 ctx_idx = g_playlist_page*g_config.playlist_sz;
-                                g_ctx = &ctxs.data[g_playlist_page*g_config.playlist_sz];
+                                g_ctx = ctx_select(&ctxs, ctx_idx);
                         }
                 } break;
                 case ']': {
                         if (g_playlist_page < g_total_playlist_pages-1) {
                                 ++g_playlist_page;
                                 ctx_idx = g_playlist_page*g_config.playlist_sz;
-                                g_ctx = &ctxs.data[g_playlist_page*g_config.playlist_sz];
+                                g_ctx = ctx_select(&ctxs, ctx_idx);
                         }
                 } break;
                 case 'z': {
                         reset_view(g_ctx);
                 } break;
+                case 'e': {
+                        export_playlist(g_ctx);
+                } break;
+                case 'r': {
+                        if (!g_ctx) break;
+                        char *name = get_userin("Rename Playlist:", g_ctx->pname);
+                        if (name && strcmp(name, "")
+                            && (!g_ctx->playlist_saved || io_rename_playlist(g_ctx->pname, name))) {
+                                g_ctx->pname = arena_strdup(g_ctx->arena, name);
+                        }
+                        free(name);
+                } break;
                 case 'd':
                 case 'D': {
                         if (g_ctx && io_del_playlist(g_ctx->pname)) {
-                                // TODO: handle memory
+                                ctx_free(g_ctx);
                                 dyn_array_rm_at(ctxs, ctx_idx);
                                 for (size_t i = ctx_idx; i < ctxs.len; ++i) {
                                         --ctxs.data[i].uuid;
@@ -1229,7 +1957,7 @@ void run(const Playlist_Array *playlists) {
                                 if (ctxs.len == 0) {
                                         g_ctx = NULL;
                                 } else {
-                                        g_ctx = &ctxs.data[ctx_idx];
+                                        g_ctx = ctx_select(&ctxs, ctx_idx);
                                 }
                         }
                 } break;
@@ -1249,7 +1977,7 @@ void run(const Playlist_Array *playlists) {
                                 }
                         }
                         start_song(g_ctx);
-                        dyn_array_append(g_ctx->history_idxs, g_ctx->currently_playing_index);
+                        dyn_deque_push_back(g_ctx->history_idxs, g_ctx->currently_playing_index);
                 } break;
                 default: (void)0x0;
                 }
@@ -1265,9 +1993,21 @@ void run(const Playlist_Array *playlists) {
                 }
 
         }
-/*         for (size_t i = 0; i < ctx.songnames.len; ++i) { */
-/*                 free(ctx.songnames.data[i]); */
-/*         } */
 
-/*         dyn_array_free(ctx.songnames); */
+        for (size_t i = 0; i < trees.len; ++i) {
+                scan_free(trees.data[i].scan);
+                free(trees.data[i].dir);
+        }
+        dyn_array_free(trees);
+        watch_free(&watcher);
+        meta_pipeline_free(g_meta);
+        g_meta = NULL;
+        preload_free(g_preload);
+        g_preload = NULL;
+
+        if (scan) {
+                scan_free(scan);
+        }
+
+        ctxs_free(&ctxs);
 }
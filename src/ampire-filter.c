@@ -0,0 +1,79 @@
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ampire-filter.h"
+#include "dyn_array.h"
+
+// Most patterns are just a name or `*.ext`, these
+// do not need to go through fnmatch() at all.
+typedef enum {
+        GLOB_LITERAL,
+        GLOB_PREFIX, // "abc*"
+        GLOB_SUFFIX, // "*abc"
+        GLOB_FULL,
+} Glob_Kind;
+
+typedef struct {
+        Glob_Kind   kind;
+        const char *pat;  // The literal part, or the full pattern
+        size_t      len;
+} Glob;
+
+DYN_ARRAY_TYPE(Glob, Glob_Array);
+
+static Glob_Array g_include = {0};
+static Glob_Array g_exclude = {0};
+
+static Glob glob_compile(const char *pat) {
+        size_t len = strlen(pat);
+        size_t nmeta = strcspn(pat, "*?[\\");
+
+        if (nmeta == len) {
+                return (Glob) { .kind = GLOB_LITERAL, .pat = pat, .len = len };
+        }
+        if (pat[0] == '*' && strcspn(pat+1, "*?[\\") == len-1) {
+                return (Glob) { .kind = GLOB_SUFFIX, .pat = pat+1, .len = len-1 };
+        }
+        if (nmeta == len-1 && pat[len-1] == '*') {
+                return (Glob) { .kind = GLOB_PREFIX, .pat = pat, .len = len-1 };
+        }
+        return (Glob) { .kind = GLOB_FULL, .pat = pat, .len = len };
+}
+
+static int glob_match(const Glob *g, const char *name) {
+        switch (g->kind) {
+        case GLOB_LITERAL: return !strcmp(name, g->pat);
+        case GLOB_PREFIX:  return !strncmp(name, g->pat, g->len);
+        case GLOB_SUFFIX: {
+                size_t n = strlen(name);
+                return n >= g->len && !memcmp(name + n - g->len, g->pat, g->len);
+        }
+        case GLOB_FULL:    return fnmatch(g->pat, name, 0) == 0;
+        }
+        return 0;
+}
+
+static int any_match(const Glob_Array *globs, const char *name) {
+        for (size_t i = 0; i < globs->len; ++i) {
+                if (glob_match(&globs->data[i], name)) return 1;
+        }
+        return 0;
+}
+
+void filter_include(const char *glob) {
+        dyn_array_append(g_include, glob_compile(glob));
+}
+
+void filter_exclude(const char *glob) {
+        dyn_array_append(g_exclude, glob_compile(glob));
+}
+
+int filter_dir(const char *name) {
+        return !any_match(&g_exclude, name);
+}
+
+int filter_file(const char *name) {
+        if (any_match(&g_exclude, name)) return 0;
+        return g_include.len == 0 || any_match(&g_include, name);
+}
@@ -0,0 +1,234 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "ampire-gapless.h"
+#include "ampire-intern.h"
+
+static struct {
+        pthread_mutex_t  lock;      // Taken by the audio callback too
+        Mix_Chunk       *cur;
+        const char      *cur_path;
+        size_t           pos;       // Bytes of `cur` that were played
+        Mix_Chunk       *next;
+        const char      *next_path;
+        Mix_Chunk       *old[2];    // Played out, the main thread frees them
+        const char      *old_paths[2];
+        size_t           nold;
+        int              moved;     // Went on to `next` since the last poll
+        int              ended;
+        float            volume;
+        int              hooked;
+        SDL_AudioFormat  format;
+        int              freq;
+        size_t           frame;     // Bytes per sample frame, 0 if unusable
+} g_gl = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .volume = 1.0f,
+};
+
+// Called by SDL_mixer with `stream` already silent.
+static void gapless_mix(void *udata, Uint8 *stream, int len) {
+        (void)udata;
+
+        pthread_mutex_lock(&g_gl.lock);
+        while (len > 0 && g_gl.cur) {
+                size_t n = g_gl.cur->alen - g_gl.pos;
+                if (n > (size_t)len) n = (size_t)len;
+                SDL_MixAudio(stream, g_gl.cur->abuf + g_gl.pos, g_gl.format, (Uint32)n, g_gl.volume);
+                stream += n;
+                len -= (int)n;
+                g_gl.pos += n;
+                if (g_gl.pos < g_gl.cur->alen) break;
+
+                // The next song starts right where this one ended, in
+                // the same buffer. Freeing takes the audio lock, so the
+                // old one is left for the main thread. At most two pile
+                // up: the one that was moved on from, then the queued one
+                // running out. Only the main thread queues another.
+                g_gl.old_paths[g_gl.nold] = g_gl.cur_path;
+                g_gl.old[g_gl.nold++] = g_gl.cur;
+                g_gl.cur = g_gl.next;
+                g_gl.cur_path = g_gl.next_path;
+                g_gl.next = NULL;
+                g_gl.next_path = NULL;
+                g_gl.pos = 0;
+                if (g_gl.cur) {
+                        g_gl.moved = 1;
+                } else {
+                        g_gl.ended = 1;
+                }
+        }
+        pthread_mutex_unlock(&g_gl.lock);
+}
+
+// Songs that are done with, freed outside of the audio lock.
+typedef struct {
+        Mix_Chunk  *chunk;
+        const char *path;
+} Gone;
+
+static void free_gone(Gone *gone, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+                if (gone[i].chunk) Mix_FreeChunk(gone[i].chunk);
+                intern_unref(gone[i].path);
+        }
+}
+
+// Hand the songs that were played out over to `gone`.
+static size_t take_old(Gone *gone) {
+        size_t n = g_gl.nold;
+        for (size_t i = 0; i < n; ++i) {
+                gone[i] = (Gone) { .chunk = g_gl.old[i], .path = g_gl.old_paths[i] };
+        }
+        g_gl.nold = 0;
+        return n;
+}
+
+int gapless_init(void) {
+        int channels = 0;
+        if (!Mix_QuerySpec(&g_gl.freq, &g_gl.format, &channels) || g_gl.freq <= 0) {
+                g_gl.frame = 0;
+                return 0;
+        }
+        g_gl.frame = (size_t)SDL_AUDIO_BYTESIZE(g_gl.format) * (size_t)channels;
+        return g_gl.frame > 0;
+}
+
+int gapless_available(void) {
+        return g_gl.frame > 0;
+}
+
+void gapless_play(Mix_Chunk *c, const char *path) {
+        pthread_mutex_lock(&g_gl.lock);
+        Gone gone[4] = { { g_gl.cur, g_gl.cur_path }, { g_gl.next, g_gl.next_path } };
+        size_t n = 2 + take_old(gone + 2);
+        g_gl.cur = c;
+        g_gl.cur_path = intern_ref((char *)path);
+        g_gl.pos = 0;
+        g_gl.next = NULL;
+        g_gl.next_path = NULL;
+        g_gl.moved = g_gl.ended = 0;
+        pthread_mutex_unlock(&g_gl.lock);
+        free_gone(gone, n);
+
+        if (!g_gl.hooked) {
+                Mix_HookMusic(gapless_mix, NULL);
+                g_gl.hooked = 1;
+        }
+}
+
+void gapless_queue(Mix_Chunk *c, const char *path) {
+        pthread_mutex_lock(&g_gl.lock);
+        Gone gone[3] = { { g_gl.next, g_gl.next_path } };
+        size_t n = 1 + take_old(gone + 1);
+        g_gl.next = c;
+        g_gl.next_path = c ? intern_ref((char *)path) : NULL;
+        pthread_mutex_unlock(&g_gl.lock);
+        free_gone(gone, n);
+}
+
+int gapless_skip(void) {
+        pthread_mutex_lock(&g_gl.lock);
+        if (!g_gl.next) {
+                pthread_mutex_unlock(&g_gl.lock);
+                return 0;
+        }
+        Gone gone[3] = { { g_gl.cur, g_gl.cur_path } };
+        size_t n = 1 + take_old(gone + 1);
+        g_gl.cur = g_gl.next;
+        g_gl.cur_path = g_gl.next_path;
+        g_gl.next = NULL;
+        g_gl.next_path = NULL;
+        g_gl.pos = 0;
+        g_gl.moved = 1;
+        pthread_mutex_unlock(&g_gl.lock);
+        free_gone(gone, n);
+        return 1;
+}
+
+void gapless_stop(void) {
+        if (g_gl.hooked) {
+                // Once this returns the callback is not running anymore.
+                Mix_HookMusic(NULL, NULL);
+                g_gl.hooked = 0;
+        }
+
+        pthread_mutex_lock(&g_gl.lock);
+        Gone gone[4] = { { g_gl.cur, g_gl.cur_path }, { g_gl.next, g_gl.next_path } };
+        size_t n = 2 + take_old(gone + 2);
+        g_gl.cur = g_gl.next = NULL;
+        g_gl.cur_path = g_gl.next_path = NULL;
+        g_gl.pos = 0;
+        g_gl.moved = g_gl.ended = 0;
+        pthread_mutex_unlock(&g_gl.lock);
+        free_gone(gone, n);
+}
+
+int gapless_playing(void) {
+        pthread_mutex_lock(&g_gl.lock);
+        int res = g_gl.hooked && g_gl.cur != NULL;
+        pthread_mutex_unlock(&g_gl.lock);
+        return res;
+}
+
+const char *gapless_current(void) {
+        pthread_mutex_lock(&g_gl.lock);
+        const char *res = g_gl.cur_path;
+        pthread_mutex_unlock(&g_gl.lock);
+        return res;
+}
+
+const char *gapless_queued(void) {
+        pthread_mutex_lock(&g_gl.lock);
+        const char *res = g_gl.next_path;
+        pthread_mutex_unlock(&g_gl.lock);
+        return res;
+}
+
+void gapless_volume(int volume) {
+        pthread_mutex_lock(&g_gl.lock);
+        g_gl.volume = (float)volume / (float)MIX_MAX_VOLUME;
+        pthread_mutex_unlock(&g_gl.lock);
+}
+
+void gapless_seek(double seconds) {
+        if (!g_gl.frame) return;
+        if (seconds < 0) seconds = 0;
+
+        pthread_mutex_lock(&g_gl.lock);
+        if (g_gl.cur) {
+                size_t pos = (size_t)(seconds * g_gl.freq) * g_gl.frame;
+                // Seeking past the end ends it, like Mix_SetMusicPosition().
+                g_gl.pos = pos < g_gl.cur->alen ? pos : g_gl.cur->alen - g_gl.cur->alen % g_gl.frame;
+        }
+        pthread_mutex_unlock(&g_gl.lock);
+}
+
+double gapless_position(void) {
+        if (!g_gl.frame) return 0;
+        pthread_mutex_lock(&g_gl.lock);
+        double res = (double)(g_gl.pos / g_gl.frame) / g_gl.freq;
+        pthread_mutex_unlock(&g_gl.lock);
+        return res;
+}
+
+Gapless_Event gapless_poll(void) {
+        Gapless_Event ev = GAPLESS_NONE;
+
+        pthread_mutex_lock(&g_gl.lock);
+        Gone gone[2];
+        size_t n = take_old(gone);
+        // Both can have happened, the song that was moved on to may
+        // have ended already. That is told on the next call.
+        if (g_gl.moved) {
+                g_gl.moved = 0;
+                ev = GAPLESS_NEXT;
+        } else if (g_gl.ended) {
+                g_gl.ended = 0;
+                ev = GAPLESS_END;
+        }
+        pthread_mutex_unlock(&g_gl.lock);
+
+        free_gone(gone, n);
+        return ev;
+}
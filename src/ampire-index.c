@@ -0,0 +1,235 @@
+#include <assert.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ampire-index.h"
+#include "dyn_array.h"
+#include "ds/strmap.h"
+
+#define INDEX_MAGIC "__ampire-index 2"
+
+// The index file is line oriented:
+//   __ampire-index 2
+//   D <mtime sec> <mtime nsec> <absolute directory path>
+//   f <device> <inode> <music file name>
+//   d <subdirectory name>
+//   D ...
+
+static void index_dir_noop_free(uint8_t *v) {
+        (void)v;
+}
+
+static char *index_own(Index *idx, const char *s) {
+        char *copy = strdup(s);
+        dyn_array_append(idx->strs, copy);
+        return copy;
+}
+
+static Index_Dir *index_dir_create(Index *idx, char *path, struct timespec mtime) {
+        Index_Dir *d = malloc(sizeof(Index_Dir));
+        d->path = path;
+        d->mtime = mtime;
+        d->entries = dyn_array_empty(Index_Entry_Array);
+        d->seen = 0;
+        d->dead = 0;
+        dyn_array_append(idx->dirs, d);
+        strmap_insert(&idx->map, path, (uint8_t *)d);
+        return d;
+}
+
+static void index_parse(Index *idx, char *buf) {
+        char *line = buf;
+        char *nl = strchr(line, '\n');
+        if (!nl) return;
+        *nl = '\0';
+        if (strcmp(line, INDEX_MAGIC)) return;
+
+        Index_Dir *cur = NULL;
+        for (line = nl+1; *line; line = nl+1) {
+                nl = strchr(line, '\n');
+                if (!nl) break; // Truncated record, ignore it
+                *nl = '\0';
+
+                if (line[0] == '\0' || line[1] != ' ') continue;
+
+                if (line[0] == 'D') {
+                        char *p = line+2, *end = NULL;
+                        struct timespec mtime = {0};
+                        mtime.tv_sec = (time_t)strtoll(p, &end, 10);
+                        if (*end != ' ') { cur = NULL; continue; }
+                        mtime.tv_nsec = strtol(end+1, &end, 10);
+                        if (*end != ' ') { cur = NULL; continue; }
+                        cur = index_dir_create(idx, end+1, mtime);
+                } else if (cur && line[0] == 'f') {
+                        char *p = line+2, *end = NULL;
+                        dev_t dev = (dev_t)strtoull(p, &end, 10);
+                        if (*end != ' ') continue;
+                        ino_t ino = (ino_t)strtoull(end+1, &end, 10);
+                        if (*end != ' ') continue;
+                        dyn_array_append(cur->entries, ((Index_Entry) {
+                                .name = end+1,
+                                .type = DT_REG,
+                                .dev = dev,
+                                .ino = ino,
+                        }));
+                } else if (cur && line[0] == 'd') {
+                        dyn_array_append(cur->entries, ((Index_Entry) {
+                                .name = line+2,
+                                .type = DT_DIR,
+                                .dev = 0,
+                                .ino = 0,
+                        }));
+                }
+        }
+}
+
+Index index_load(const char *fp) {
+        Index idx = {
+                .fp = strdup(fp),
+                .buf = NULL,
+                .strs = dyn_array_empty(Str_Array),
+                .dirs = dyn_array_empty(Index_Dir_Array),
+                .map = strmap_create(NULL, index_dir_noop_free),
+                .started = time(NULL),
+                .dirty = 0,
+        };
+
+        FILE *f = fopen(fp, "r");
+        if (!f) return idx;
+
+        if (fseek(f, 0, SEEK_END) == 0) {
+                long sz = ftell(f);
+                rewind(f);
+                if (sz > 0) {
+                        idx.buf = malloc(sz+1);
+                        size_t n = fread(idx.buf, 1, sz, f);
+                        idx.buf[n] = '\0';
+                        index_parse(&idx, idx.buf);
+                }
+        }
+
+        fclose(f);
+        return idx;
+}
+
+static Index_Dir *index_lookup(Index *idx, const char *path) {
+        return (Index_Dir *)strmap_get(&idx->map, path);
+}
+
+Index_Dir *index_get(Index *idx, const char *path) {
+        Index_Dir *d = index_lookup(idx, path);
+        return d && !d->dead ? d : NULL;
+}
+
+Index_Dir *index_put(Index *idx, const char *path, struct timespec mtime) {
+        Index_Dir *d = index_lookup(idx, path);
+        if (!d) {
+                d = index_dir_create(idx, index_own(idx, path), mtime);
+        } else {
+                d->mtime = mtime;
+                d->entries.len = 0;
+                d->dead = 0;
+        }
+        d->seen = 1;
+        idx->dirty = 1;
+        return d;
+}
+
+void index_dir_add(Index *idx, Index_Dir *d, const char *name, unsigned char type, dev_t dev, ino_t ino) {
+        dyn_array_append(d->entries, ((Index_Entry) {
+                .name = index_own(idx, name),
+                .type = type,
+                .dev = dev,
+                .ino = ino,
+        }));
+}
+
+void index_seen(Index *idx, const char *path) {
+        Index_Dir *d = index_lookup(idx, path);
+        if (d) d->seen = 1;
+}
+
+void index_prune(Index *idx, const char *root) {
+        size_t n = strlen(root);
+        if (n > 0 && root[n-1] == '/') --n;
+
+        for (size_t i = 0; i < idx->dirs.len; ++i) {
+                Index_Dir *d = idx->dirs.data[i];
+                if (d->dead || d->seen) continue;
+                if (!strncmp(d->path, root, n) && (d->path[n] == '/' || d->path[n] == '\0')) {
+                        d->dead = 1;
+                        idx->dirty = 1;
+                }
+        }
+}
+
+static int index_dir_writable(const Index *idx, const Index_Dir *d) {
+        // A directory modified within the same second that we read
+        // it in could change again without its mtime changing, so
+        // it has to be read again next time.
+        if (d->mtime.tv_sec >= idx->started - 1) return 0;
+
+        if (strchr(d->path, '\n')) return 0;
+        for (size_t i = 0; i < d->entries.len; ++i) {
+                if (strchr(d->entries.data[i].name, '\n')) return 0;
+        }
+        return 1;
+}
+
+void index_save(Index *idx) {
+        if (!idx->dirty) return;
+
+        size_t n = strlen(idx->fp);
+        char *tmp = malloc(n + sizeof(".tmp"));
+        memcpy(tmp, idx->fp, n);
+        memcpy(tmp+n, ".tmp", sizeof(".tmp"));
+
+        FILE *f = fopen(tmp, "w");
+        if (!f) {
+                perror("fopen");
+                free(tmp);
+                return;
+        }
+        setvbuf(f, NULL, _IOFBF, 1 << 16);
+
+        fprintf(f, "%s\n", INDEX_MAGIC);
+        for (size_t i = 0; i < idx->dirs.len; ++i) {
+                const Index_Dir *d = idx->dirs.data[i];
+                if (d->dead || !index_dir_writable(idx, d)) continue;
+                fprintf(f, "D %lld %ld %s\n", (long long)d->mtime.tv_sec, (long)d->mtime.tv_nsec, d->path);
+                for (size_t j = 0; j < d->entries.len; ++j) {
+                        const Index_Entry *e = &d->entries.data[j];
+                        if (e->type == DT_DIR) {
+                                fprintf(f, "d %s\n", e->name);
+                        } else {
+                                fprintf(f, "f %llu %llu %s\n", (unsigned long long)e->dev, (unsigned long long)e->ino, e->name);
+                        }
+                }
+        }
+
+        if (fclose(f) != 0 || rename(tmp, idx->fp) == -1) {
+                perror("index_save");
+                (void)remove(tmp);
+        } else {
+                idx->dirty = 0;
+        }
+
+        free(tmp);
+}
+
+void index_free(Index *idx) {
+        for (size_t i = 0; i < idx->dirs.len; ++i) {
+                dyn_array_free(idx->dirs.data[i]->entries);
+                free(idx->dirs.data[i]);
+        }
+        for (size_t i = 0; i < idx->strs.len; ++i) {
+                free(idx->strs.data[i]);
+        }
+        dyn_array_free(idx->dirs);
+        dyn_array_free(idx->strs);
+        strmap_free(&idx->map);
+        free(idx->buf);
+        free(idx->fp);
+}
@@ -0,0 +1,170 @@
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ampire-intern.h"
+#include "dyn_hash.h"
+
+#define INTERN_INIT_CAP 1024 // Slots, a power of two
+
+// Every string is kept right behind its count,
+// so one is found from the other by pointer math.
+typedef struct {
+        size_t refs;
+        char   str[];
+} Interned;
+
+// Open addressing. The hash of every string is kept, so most slots
+// that do not match are skipped without comparing the strings, and
+// growing does not need to hash them again.
+static struct {
+        Interned **slots;
+        uint64_t  *hashes;
+        size_t     len, cap;
+} g_paths;
+static pthread_mutex_t g_paths_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t hash_str(const char *s) {
+        uint64_t h = 14695981039346656037ull;
+        for (; *s; ++s) {
+                h ^= (unsigned char)*s;
+                h *= 1099511628211ull;
+        }
+        return dyn_hash_u64(h);
+}
+
+static Interned *interned_of(const char *s) {
+        return (Interned *)(s - offsetof(Interned, str));
+}
+
+// The slot `s` is in, or the empty one it would go into.
+static size_t find_slot(const char *s, uint64_t h) {
+        size_t mask = g_paths.cap - 1, i = h & mask;
+        while (g_paths.slots[i]
+               && (g_paths.hashes[i] != h || strcmp(g_paths.slots[i]->str, s))) {
+                i = (i + 1) & mask;
+        }
+        return i;
+}
+
+static void grow(void) {
+        Interned **slots = g_paths.slots;
+        uint64_t *hashes = g_paths.hashes;
+        size_t cap = g_paths.cap;
+
+        g_paths.cap = cap ? cap * 2 : INTERN_INIT_CAP;
+        g_paths.slots = calloc(g_paths.cap, sizeof(Interned *));
+        g_paths.hashes = malloc(g_paths.cap * sizeof(uint64_t));
+
+        size_t mask = g_paths.cap - 1;
+        for (size_t i = 0; i < cap; ++i) {
+                if (!slots[i]) continue;
+                size_t j = hashes[i] & mask;
+                while (g_paths.slots[j]) j = (j + 1) & mask;
+                g_paths.slots[j] = slots[i];
+                g_paths.hashes[j] = hashes[i];
+        }
+
+        free(slots);
+        free(hashes);
+}
+
+char *intern(const char *s) {
+        uint64_t h = hash_str(s);
+
+        pthread_mutex_lock(&g_paths_lock);
+        // Keep 1/8 of the slots empty so probes stay short.
+        if (g_paths.len + 1 > g_paths.cap - g_paths.cap/8) grow();
+        size_t i = find_slot(s, h);
+        Interned *e = g_paths.slots[i];
+        if (!e) {
+                size_t n = strlen(s);
+                e = malloc(sizeof(Interned) + n + 1);
+                e->refs = 0;
+                memcpy(e->str, s, n + 1);
+                g_paths.slots[i] = e;
+                g_paths.hashes[i] = h;
+                ++g_paths.len;
+        }
+        ++e->refs;
+        pthread_mutex_unlock(&g_paths_lock);
+
+        return e->str;
+}
+
+char *intern_n(const char *s, size_t n) {
+        char buf[1024];
+        char *tmp = n < sizeof(buf) ? buf : malloc(n + 1);
+        memcpy(tmp, s, n);
+        tmp[n] = '\0';
+        char *res = intern(tmp);
+        if (tmp != buf) free(tmp);
+        return res;
+}
+
+char *intern_path(const char *dir, const char *name) {
+        size_t dn = strlen(dir), nn = strlen(name);
+        if (dn > 0 && dir[dn-1] == '/') --dn;
+        char buf[1024];
+        char *tmp = dn + nn + 2 <= sizeof(buf) ? buf : malloc(dn + nn + 2);
+        memcpy(tmp, dir, dn);
+        tmp[dn] = '/';
+        memcpy(tmp + dn + 1, name, nn + 1);
+        char *res = intern(tmp);
+        if (tmp != buf) free(tmp);
+        return res;
+}
+
+char *intern_find(const char *s) {
+        uint64_t h = hash_str(s);
+
+        pthread_mutex_lock(&g_paths_lock);
+        Interned *e = g_paths.cap ? g_paths.slots[find_slot(s, h)] : NULL;
+        pthread_mutex_unlock(&g_paths_lock);
+
+        return e ? e->str : NULL;
+}
+
+char *intern_ref(char *s) {
+        if (!s) return NULL;
+        pthread_mutex_lock(&g_paths_lock);
+        ++interned_of(s)->refs;
+        pthread_mutex_unlock(&g_paths_lock);
+        return s;
+}
+
+void intern_unref(const char *s) {
+        if (!s) return;
+
+        pthread_mutex_lock(&g_paths_lock);
+        Interned *e = interned_of(s);
+        if (--e->refs > 0) {
+                pthread_mutex_unlock(&g_paths_lock);
+                return;
+        }
+
+        size_t mask = g_paths.cap - 1, i = find_slot(s, hash_str(s));
+        // Close the gap, so that probing for what comes after it
+        // does not stop early.
+        for (size_t j = (i + 1) & mask; g_paths.slots[j]; j = (j + 1) & mask) {
+                size_t h = g_paths.hashes[j] & mask;
+                if (__dyn_hash_moves(i, j, h)) {
+                        g_paths.slots[i] = g_paths.slots[j];
+                        g_paths.hashes[i] = g_paths.hashes[j];
+                        i = j;
+                }
+        }
+        g_paths.slots[i] = NULL;
+        --g_paths.len;
+        pthread_mutex_unlock(&g_paths_lock);
+
+        free(e);
+}
+
+void intern_unref_all(const Str_Array *songfps) {
+        for (size_t i = 0; i < songfps->len; ++i) {
+                intern_unref(songfps->data[i]);
+        }
+}
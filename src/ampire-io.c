@@ -1,200 +1,42 @@
 #include <assert.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "ampire-io.h"
+#include "ampire-scan.h"
+#include "ampire-db.h"
+#include "ampire-intern.h"
+#include "ampire-m3u.h"
 #include "ds/array.h"
+#include "ds/arena.h"
 #include "dyn_array.h"
 #include "ampire-flag.h"
 #include "ampire-ncurses-helpers.h"
 #include "ampire-global.h"
 
-static int is_music_f(const char *fp) {
-        size_t last = 0;
-        for (size_t i = 0; fp[i]; ++i) {
-                if (fp[i] == '.') {
-                        last = i;
-                }
-        }
-        char buf[256] = {0};
-        (void)strncpy(buf, fp+last+1, strlen(fp+last+1));
-        return !strcmp(buf, "wav") || !strcmp(buf, "ogg") || !strcmp(buf, "mp3") || !strcmp(buf, "opus");
-}
-
-/* static void walk(const char *path, Str_Array *arr) { */
-/*         // Convert input path to absolute path */
-/*         char *abs_path = realpath(path, NULL); */
-/*         if (!abs_path) { */
-/*                 perror("realpath"); */
-/*                 display_temp_message("Failed to resolve absolute path!"); */
-/*                 return; */
-/*         } */
-
-/*         struct stat st; */
-/*         if (stat(abs_path, &st) == -1) { */
-/*                 perror("stat"); */
-/*                 free(abs_path); */
-/*                 return; */
-/*         } */
-
-/*         // Check if it's a regular file and a music file */
-/*         if (S_ISREG(st.st_mode) && is_music_f(abs_path)) { */
-/*                 dyn_array_append(*arr, strdup(abs_path)); */
-/*                 free(abs_path); */
-/*                 return; */
-/*         } */
-
-/*         // If it's not a directory, print error and return */
-/*         if (!S_ISDIR(st.st_mode)) { */
-/*                 char msg[256]; */
-/*                 snprintf(msg, sizeof(msg), "Path %s is not a directory or a supported file format", abs_path); */
-/*                 display_temp_message(msg); */
-/*                 free(abs_path); */
-/*                 return; */
-/*         } */
-
-/*         // Open directory */
-/*         DIR *dir = opendir(abs_path); */
-/*         if (!dir) { */
-/*                 perror("opendir"); */
-/*                 free(abs_path); */
-/*                 return; */
-/*         } */
-
-/*         struct dirent *entry; */
-/*         while ((entry = readdir(dir)) != NULL) { */
-/*                 // Skip "." and ".." */
-/*                 if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) { */
-/*                         continue; */
-/*                 } */
-
-/*                 // Build full absolute subpath */
-/*                 char subpath[PATH_MAX]; */
-/*                 snprintf(subpath, sizeof(subpath), "%s/%s", abs_path, entry->d_name); */
-
-/*                 // Verify subpath is valid by getting its absolute path */
-/*                 char *abs_subpath = realpath(subpath, NULL); */
-/*                 if (!abs_subpath) { */
-/*                         perror("realpath"); */
-/*                         continue; // Skip invalid paths */
-/*                 } */
-
-/*                 if (stat(abs_subpath, &st) == -1) { */
-/*                         perror("stat"); */
-/*                         free(abs_subpath); */
-/*                         continue; */
-/*                 } */
-
-/*                 // Check if it's a regular file and a music file */
-/*                 if (S_ISREG(st.st_mode) && is_music_f(entry->d_name)) { */
-/*                         dyn_array_append(*arr, strdup(abs_subpath)); */
-/*                 } else if (S_ISDIR(st.st_mode) && (g_config.flags & FT_RECURSIVE)) { */
-/*                         // Recursive call with absolute subpath */
-/*                         walk(abs_subpath, arr); */
-/*                 } */
-
-/*                 free(abs_subpath); */
-/*         } */
-
-/*         closedir(dir); */
-/*         free(abs_path); */
-/* } */
-
-/* Playlist_Array io_flatten_dirs(const Str_Array *dirs) { */
-/*         Playlist_Array pa = dyn_array_empty(Playlist_Array); */
-
-/*         for (size_t i = 0; i < dirs->len; ++i) { */
-/*                 Str_Array arr = dyn_array_empty(Str_Array); */
-/*                 walk(dirs->data[i], &arr); */
-/*                 dyn_array_append(pa, ((Playlist) { */
-/*                         .songfps = arr, */
-/*                         .name = dirs->data[i], */
-/*                         .from_cli = 1, */
-/*                 })); */
-/*         } */
-
-/*         return pa; */
-/* } */
-
-void walk(const char *path, Str_Array *arr) {
-        char *abs_path = realpath(path, NULL);
-        if (!abs_path) {
-                perror("realpath");
-                display_temp_message("Failed to resolve absolute path!");
-                return;
-        }
-
-        struct stat st;
-        if (stat(abs_path, &st) == -1) {
-                perror("stat");
-                free(abs_path);
-                return;
-        }
-
-        if (S_ISREG(st.st_mode) && is_music_f(abs_path)) {
-                dyn_array_append(*arr, strdup(abs_path));
-                free(abs_path);
-                return;
-        }
-
-        if (!S_ISDIR(st.st_mode)) {
-                char msg[256];
-                snprintf(msg, sizeof(msg), "Path %s is not a directory or a supported file format", abs_path);
-                display_temp_message(msg);
-                free(abs_path);
-                return;
-        }
-
-        DIR *dir = opendir(abs_path);
-        if (!dir) {
-                perror("opendir");
-                free(abs_path);
-                return;
-        }
-
-        struct dirent *entry;
-        while ((entry = readdir(dir)) != NULL) {
-                // Skip "." and ".."
-                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-                        continue;
-                }
-
-                char subpath[PATH_MAX];
-                snprintf(subpath, sizeof(subpath), "%s/%s", abs_path, entry->d_name);
-
-                // Verify subpath is valid by getting its absolute path
-                char *abs_subpath = realpath(subpath, NULL);
-                if (!abs_subpath) {
-                        perror("realpath");
-                        continue;
-                }
-
-                if (stat(abs_subpath, &st) == -1) {
-                        perror("stat");
-                        free(abs_subpath);
-                        continue;
-                }
-
-                // Check if it's a regular file and a music file
-                if (S_ISREG(st.st_mode) && is_music_f(entry->d_name)) {
-                        dyn_array_append(*arr, strdup(abs_subpath));
-                } else if (S_ISDIR(st.st_mode) && (g_config.flags & FT_RECURSIVE)) {
-                        // Recursive call with absolute subpath
-                        walk(abs_subpath, arr);
-                }
-
-                free(abs_subpath);
-        }
-
-        closedir(dir);
-        free(abs_path);
+static char *get_index_fp(void) {
+        char *buf = malloc(1024);
+        memset(buf, '\0', 1024);
+        const char *home = getenv("HOME");
+        strcat(buf, home);
+        strcat(buf, "/");
+        strcat(buf, ".ampire-index");
+        return buf;
 }
 
-Playlist_Array io_flatten_dirs(const Str_Array *dirs) {
+// Turn the paths given on the command line into playlists. Music files
+// are added right away, directories are appended to `roots` and the
+// playlist remembers which root it is in `scan_root`.
+static Playlist_Array io_resolve_dirs(const Str_Array *dirs, Str_Array *roots) {
         Playlist_Array pa = dyn_array_empty(Playlist_Array);
 
         for (size_t i = 0; i < dirs->len; ++i) {
@@ -207,20 +49,93 @@ Playlist_Array io_flatten_dirs(const Str_Array *dirs) {
                         continue;
                 }
 
+                struct stat st;
+                if (stat(abs_dir, &st) == -1) {
+                        perror("stat");
+                        free(abs_dir);
+                        continue;
+                }
+
                 Str_Array arr = dyn_array_empty(Str_Array);
-                walk(abs_dir, &arr);
+                Arena *arena = arena_create();
+                size_t root = SCAN_NO_ROOT;
+                if (S_ISREG(st.st_mode) && m3u_is_playlist(abs_dir)) {
+                        (void)m3u_read(abs_dir, &arr);
+                } else if (S_ISREG(st.st_mode) && is_music_f(abs_dir) && is_music_content(AT_FDCWD, abs_dir)) {
+                        dyn_array_append(arr, intern(abs_dir));
+                } else if (S_ISDIR(st.st_mode)) {
+                        root = roots->len;
+                        dyn_array_append(*roots, strdup(abs_dir));
+                } else {
+                        char msg[256];
+                        snprintf(msg, sizeof(msg), "Path %s is not a directory or a supported file format", abs_dir);
+                        display_temp_message(msg);
+                }
+
                 dyn_array_append(pa, ((Playlist) {
                         .songfps = arr,
-                        .name = abs_dir,
+                        .arena = arena,
+                        .name = arena_strdup(arena, abs_dir),
                         .from_cli = 1,
+                        .loaded = 1,
+                        .scan = NULL,
+                        .scan_root = root,
                 }));
-                // Note: abs_dir is not free()'d here because it's used in the Playlist struct.
-                // Ensure Playlist struct or its cleanup function free()'s .name later.
+                free(abs_dir);
         }
 
         return pa;
 }
 
+Playlist_Array io_flatten_dirs(const Str_Array *dirs) {
+        Str_Array roots = dyn_array_empty(Str_Array);
+        Playlist_Array pa = io_resolve_dirs(dirs, &roots);
+
+        if (roots.len > 0) {
+                char *indexfp = get_index_fp();
+                Scan *scan = scan_start(&roots, indexfp);
+                free(indexfp);
+
+                scan_wait(scan);
+                for (size_t i = 0; i < pa.len; ++i) {
+                        if (pa.data[i].scan_root != SCAN_NO_ROOT) {
+                                (void)scan_drain(scan, pa.data[i].scan_root, 1, &pa.data[i].songfps, NULL);
+                                pa.data[i].scan_root = SCAN_NO_ROOT;
+                        }
+                }
+                scan_free(scan);
+        }
+
+        for (size_t i = 0; i < roots.len; ++i) {
+                free(roots.data[i]);
+        }
+        dyn_array_free(roots);
+        return pa;
+}
+
+Playlist_Array io_scan_dirs(const Str_Array *dirs) {
+        Str_Array roots = dyn_array_empty(Str_Array);
+        Playlist_Array pa = io_resolve_dirs(dirs, &roots);
+
+        if (roots.len > 0) {
+                char *indexfp = get_index_fp();
+                Scan *scan = scan_start(&roots, indexfp);
+                free(indexfp);
+
+                for (size_t i = 0; i < pa.len; ++i) {
+                        if (pa.data[i].scan_root != SCAN_NO_ROOT) {
+                                pa.data[i].scan = scan;
+                        }
+                }
+        }
+
+        for (size_t i = 0; i < roots.len; ++i) {
+                free(roots.data[i]);
+        }
+        dyn_array_free(roots);
+        return pa;
+}
+
 static char *get_config_fp(void) {
         char *buf = malloc(1024);
         memset(buf, '\0', 1024);
@@ -231,420 +146,785 @@ static char *get_config_fp(void) {
         return buf;
 }
 
-#include <ncurses.h>
+static char *get_db_fp(void) {
+        char *buf = malloc(1024);
+        memset(buf, '\0', 1024);
+        const char *home = getenv("HOME");
+        strcat(buf, home);
+        strcat(buf, "/");
+        strcat(buf, ".ampire.db");
+        return buf;
+}
 
-void io_write_to_config_file(const char *pname, const Str_Array *filepaths) {
-        char *configfp = get_config_fp();
-        FILE *f = fopen(configfp, "a");
-
-        // Find the longest filepath length
-        size_t max_filepath_len = 0;
-        for (size_t i = 0; i < filepaths->len; ++i) {
-                size_t len = strlen(filepaths->data[i]);
-                if (len > max_filepath_len) {
-                        max_filepath_len = len;
-                }
-        }
+static char *get_journal_fp(void) {
+        char *buf = malloc(1024);
+        memset(buf, '\0', 1024);
+        const char *home = getenv("HOME");
+        strcat(buf, home);
+        strcat(buf, "/");
+        strcat(buf, ".ampire.journal");
+        return buf;
+}
 
-        int max_y, max_x;
-        getmaxyx(stdscr, max_y, max_x);
-        int win_height = 10;
-        // Add padding (e.g., 10 for "saving: " and some extra space)
-        int win_width = max_filepath_len + 10;
-        // Ensure window doesn't exceed screen width
-        if (win_width > max_x - 2) {
-                win_width = max_x - 2;
+static char *get_store_fp(const char *name) {
+        char *buf = malloc(1024);
+        memset(buf, '\0', 1024);
+        const char *home = getenv("HOME");
+        strcat(buf, home);
+        strcat(buf, "/");
+        strcat(buf, ".ampire.d");
+        if (name) {
+                strcat(buf, "/");
+                strcat(buf, name);
         }
-        int start_y = (max_y - win_height) / 2; // Center vertically
-        int start_x = (max_x - win_width) / 2;  // Center horizontally
+        return buf;
+}
 
-        WINDOW *win = newwin(win_height, win_width, start_y, start_x);
-        box(win, 0, 0);
+static char *get_playlist_fp(size_t id) {
+        char name[32];
+        snprintf(name, sizeof(name), "%zu.db", id);
+        return get_store_fp(name);
+}
 
-        fprintf(f, "__ampire-playlist\n");
-        fprintf(f, "%s\n", pname);
-        for (size_t i = 0; i < filepaths->len; ++i) {
-                wmove(win, 1, 1);
-                wclrtoeol(win); // Clear the line to the end
-                mvwprintw(win, 1, 1, "saving: %s", filepaths->data[i]);
-                wrefresh(win);
-                fprintf(f, "%s\n", filepaths->data[i]);
-        }
+// Every saved playlist has a file of its own in ~/.ampire.d, named
+// after its id, so that saving one does not touch the others. The
+// manifest has their names, in order:
+//   ampire-manifest 1
+//   <id> <name>
+#define MANIFEST_MAGIC "ampire-manifest 1"
+
+typedef struct {
+        size_t     id;
+        char      *name;
+        int        loaded;  // Until then `songfps` is empty
+        Str_Array  songfps;
+} Saved_Playlist;
+
+DYN_ARRAY_TYPE(Saved_Playlist, Saved_Playlist_Array);
+
+typedef struct {
+        size_t      id;
+        const char *name;
+} Manifest_Entry;
+
+DYN_ARRAY_TYPE(Manifest_Entry, Manifest);
+
+// The playlists as they are on disk right now. The songs are interned,
+// the names are in `g_text` or were given to us.
+static Arena               *g_text    = NULL;
+static Saved_Playlist_Array g_saved   = {0};
+static size_t               g_next_id = 1;
+
+// One change, for the save thread to write out.
+typedef struct {
+        int           write;        // The file of `id` gets `songfps`
+        size_t        id;
+        const char   *name;
+        Str_Array     songfps;
+        Size_T_Array  removed;      // Files that go away
+        int           has_manifest; // `manifest` is what it is after this
+        Manifest      manifest;
+        size_t        size;         // For the progress
+} Save_Job;
+
+DYN_ARRAY_TYPE(Save_Job, Save_Job_Array);
+
+// Changes waiting for the save thread. `g_saved` has them already.
+static pthread_mutex_t      g_save_lock     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t       g_save_cond     = PTHREAD_COND_INITIALIZER;
+static Save_Job_Array       g_pending       = {0};
+static int                  g_save_quit     = 0;
+static pthread_t            g_saver;
+static int                  g_saver_running = 0;
+static atomic_size_t        g_save_done     = 0; // Bytes, for io_saving()
+static atomic_size_t        g_save_total    = 0;
+static atomic_int           g_save_failed   = 0;
+
+// The copy is interned and holds a reference to every song. The ones
+// that stay in here are never given back, saved songs live until we exit.
+static Str_Array copy_songs(const Str_Array *songfps) {
+        Str_Array res = dyn_array_empty(Str_Array);
+        dyn_array_reserve(res, songfps->len);
+        for (size_t i = 0; i < songfps->len; ++i) {
+                dyn_array_append(res, intern(songfps->data[i]));
+        }
+        return res;
+}
 
-        delwin(win);
-        free(configfp);
-        fclose(f);
+static Saved_Playlist *find_saved(const char *name) {
+        for (size_t i = 0; i < g_saved.len; ++i) {
+                if (!strcmp(g_saved.data[i].name, name)) return &g_saved.data[i];
+        }
+        return NULL;
 }
 
-int io_replace_playlist_songs(const char *pname, const Str_Array *songfps) {
-        if (!pname || !songfps) {
-                display_temp_message("Invalid playlist name or song list!");
-                return 0;
+static void intern_songs(Str_Array *songfps) {
+        for (size_t i = 0; i < songfps->len; ++i) {
+                songfps->data[i] = intern(songfps->data[i]);
         }
+}
 
-        // Get config file path
-        char *configfp = get_config_fp();
-        if (!configfp) {
-                display_temp_message("Failed to get config file path!");
-                return 0;
+static const Str_Array *saved_songs(Saved_Playlist *p) {
+        if (p->loaded) return &p->songfps;
+        p->loaded = 1;
+
+        Db db;
+        char *fp = get_playlist_fp(p->id);
+        if (db_open(fp, &db)) {
+                if (db_len(&db) > 0) {
+                        db_songs(&db, 0, &p->songfps);
+                        intern_songs(&p->songfps);
+                }
+                db_close(&db);
         }
+        free(fp);
+        return &p->songfps;
+}
 
-        // Open file for reading
-        FILE *f = fopen(configfp, "r");
-        if (!f) {
-                perror("fopen");
-                display_temp_message("Failed to open config file for reading!");
-                free(configfp);
-                return 0;
+// Make the songs of `r` the ones of `p`, taking over `r->songfps`.
+static void set_saved_songs(Saved_Playlist *p, Db_Record *r) {
+        dyn_array_free(p->songfps);
+        p->loaded = 1;
+        p->songfps = r->songfps;
+        if (r->songs) {
+                db_record_songs(r, &p->songfps);
+                intern_songs(&p->songfps);
         }
+}
 
-        // Read all lines into a dynamic array
-        Str_Array old_lines = dyn_array_empty(Str_Array);
-        char *line = NULL;
-        size_t len = 0;
-        ssize_t read;
+static Saved_Playlist *add_saved(Db_Record *r) {
+        Saved_Playlist p = {
+                .id = g_next_id++,
+                .name = (char *)r->name,
+                .loaded = 1,
+                .songfps = dyn_array_empty(Str_Array),
+        };
+        set_saved_songs(&p, r);
+        dyn_array_append(g_saved, p);
+        return &g_saved.data[g_saved.len-1];
+}
 
-        while ((read = getline(&line, &len, f)) != -1) {
-                if (read > 0 && line[read - 1] == '\n') {
-                        line[read - 1] = '\0';
-                        read--;
+// Apply a change to `g_saved`, taking over `r->songfps`. What
+// has to be written for it goes into `job` if it is not NULL.
+static void apply_record(Db_Record *r, Save_Job *job) {
+        Saved_Playlist *p = NULL;
+        int manifest = 0;
+
+        switch (r->op) {
+        case DB_OP_CREATE: {
+                p = add_saved(r);
+                manifest = 1;
+        } break;
+        case DB_OP_REPLACE: {
+                p = find_saved(r->name);
+                if (p) {
+                        set_saved_songs(p, r);
+                } else {
+                        p = add_saved(r);
+                        manifest = 1;
                 }
-                if (read == 0 || !strcmp(line, "")) {
-                        continue;
+        } break;
+        case DB_OP_DELETE: {
+                size_t n = 0;
+                for (size_t i = 0; i < g_saved.len; ++i) {
+                        if (strcmp(g_saved.data[i].name, r->name)) {
+                                g_saved.data[n++] = g_saved.data[i];
+                        } else {
+                                if (job) dyn_array_append(job->removed, g_saved.data[i].id);
+                                dyn_array_free(g_saved.data[i].songfps);
+                        }
                 }
-                char *copy = strdup(line);
-                if (!copy) {
-                        perror("strdup");
-                        display_temp_message("Memory allocation failed!");
-                        fclose(f);
-                        free(line);
-                        free(configfp);
-                        dyn_array_free(old_lines);
-                        return 0;
+                g_saved.len = n;
+                dyn_array_free(r->songfps);
+                manifest = 1;
+        } break;
+        case DB_OP_RENAME: {
+                Saved_Playlist *q = find_saved(r->name);
+                if (q) q->name = (char *)r->newname;
+                dyn_array_free(r->songfps);
+                manifest = 1;
+        } break;
+        default: {
+                // From a newer version, nothing we can do with it.
+                dyn_array_free(r->songfps);
+        } break;
+        }
+
+        if (!job) return;
+
+        if (p) {
+                job->write = 1;
+                job->id = p->id;
+                job->name = p->name;
+                job->songfps = copy_songs(&p->songfps);
+                Db_Entry e = { .name = p->name, .songfps = &job->songfps };
+                job->size = db_size_max(&e, 1);
+        }
+        if (manifest) {
+                job->has_manifest = 1;
+                for (size_t i = 0; i < g_saved.len; ++i) {
+                        dyn_array_append(job->manifest, ((Manifest_Entry) {
+                                .id = g_saved.data[i].id,
+                                .name = g_saved.data[i].name,
+                        }));
                 }
-                dyn_array_append(old_lines, copy);
         }
+}
 
-        if (ferror(f)) {
-                perror("fread");
-                display_temp_message("Error reading config file!");
-                fclose(f);
-                free(line);
-                free(configfp);
-                dyn_array_free(old_lines);
-                return 0;
+static int write_playlist(size_t id, const char *name, const Str_Array *songfps) {
+        char *fp = get_playlist_fp(id);
+        Db_Entry e = { .name = name, .songfps = songfps };
+        int ok = db_write(fp, &e, 1, 0, &g_save_done);
+        free(fp);
+        return ok;
+}
+
+static int write_manifest(const Manifest *m) {
+        char *fp = get_store_fp("manifest");
+        char tmpfp[1100];
+        snprintf(tmpfp, sizeof(tmpfp), "%s.tmp", fp);
+
+        int ok = 0;
+        FILE *f = fopen(tmpfp, "w");
+        if (f) {
+                fprintf(f, "%s\n", MANIFEST_MAGIC);
+                for (size_t i = 0; i < m->len; ++i) {
+                        fprintf(f, "%zu %s\n", m->data[i].id, m->data[i].name);
+                }
+                ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+                if (fclose(f) != 0) ok = 0;
+                ok = ok && rename(tmpfp, fp) == 0;
         }
-        fclose(f);
+        if (!ok) {
+                perror("write_manifest");
+                (void)unlink(tmpfp);
+        }
+
+        free(fp);
+        return ok;
+}
+
+// Returns 0 if there is no manifest or it is not one.
+static int read_manifest(void) {
+        char *fp = get_store_fp("manifest");
+        FILE *f = fopen(fp, "r");
+        free(fp);
+        if (!f) return 0;
+
+        if (!g_text) g_text = arena_create();
+
+        char *line = NULL;
+        size_t len = 0;
+        ssize_t read = getline(&line, &len, f);
+        int ok = read > 0 && !strcmp(line, MANIFEST_MAGIC "\n");
+
+        while (ok && (read = getline(&line, &len, f)) != -1) {
+                if (line[read-1] == '\n') line[read-1] = '\0';
+
+                char *name;
+                size_t id = strtoull(line, &name, 10);
+                if (name == line || *name != ' ') continue;
+
+                dyn_array_append(g_saved, ((Saved_Playlist) {
+                        .id = id,
+                        .name = arena_strdup(g_text, name+1),
+                        .loaded = 0,
+                        .songfps = dyn_array_empty(Str_Array),
+                }));
+                if (id >= g_next_id) g_next_id = id+1;
+        }
+
         free(line);
+        fclose(f);
+        return ok;
+}
 
-        // Create new lines, replacing songs for the target playlist
-        Str_Array new_lines = dyn_array_empty(Str_Array);
-        int skip = 0; // Flag to skip existing songs in the target playlist
-        int expect_name = 0; // Flag to expect playlist name after __ampire-playlist
+static int saved_id_cmp(const void *a, const void *b) {
+        size_t x = ((const Saved_Playlist *)a)->id, y = ((const Saved_Playlist *)b)->id;
+        return (x > y) - (x < y);
+}
 
-        for (size_t i = 0; i < old_lines.len; i++) {
-                char *current_line = old_lines.data[i];
+// The manifest is gone but the playlists are not, every <id>.db
+// has the name of its playlist in it too. They come back in the
+// order they were made in.
+static void recover_manifest(const char *dirfp) {
+        DIR *dir = opendir(dirfp);
+        if (!dir) {
+                perror(dirfp);
+                return;
+        }
 
-                if (!strcmp(current_line, "__ampire-playlist")) {
-                        skip = 0;
-                        expect_name = 1;
-                        dyn_array_append(new_lines, strdup(current_line));
-                        continue;
+        struct dirent *de;
+        while ((de = readdir(dir))) {
+                char *end;
+                size_t id = strtoull(de->d_name, &end, 10);
+                if (end == de->d_name || strcmp(end, ".db")) continue;
+                if (id >= g_next_id) g_next_id = id+1;
+
+                Db db;
+                char *fp = get_playlist_fp(id);
+                if (db_open(fp, &db)) {
+                        if (db_len(&db) > 0) {
+                                dyn_array_append(g_saved, ((Saved_Playlist) {
+                                        .id = id,
+                                        .name = arena_strdup(g_text, db_name(&db, 0)),
+                                        .loaded = 0,
+                                        .songfps = dyn_array_empty(Str_Array),
+                                }));
+                        }
+                        db_close(&db);
                 }
+                free(fp);
+        }
+        closedir(dir);
 
-                if (expect_name) {
-                        expect_name = 0;
-                        dyn_array_append(new_lines, strdup(current_line));
-                        if (!strcmp(current_line, pname)) {
-                                skip = 1; // Start skipping existing songs
-                                // Add new songs from songfps
-                                for (size_t j = 0; j < songfps->len; j++) {
-                                        char *song_copy = strdup(songfps->data[j]);
-                                        if (!song_copy) {
-                                                perror("strdup");
-                                                display_temp_message("Memory allocation failed!");
-                                                dyn_array_free(old_lines);
-                                                dyn_array_free(new_lines);
-                                                free(configfp);
-                                                return 0;
-                                        }
-                                        dyn_array_append(new_lines, song_copy);
-                                }
+        qsort(g_saved.data, g_saved.len, sizeof(Saved_Playlist), saved_id_cmp);
+}
+
+static void free_job(Save_Job *job) {
+        dyn_array_free(job->songfps);
+        dyn_array_free(job->removed);
+        dyn_array_free(job->manifest);
+}
+
+// Write out a batch of changes. A playlist is written before it is in
+// the manifest and only deleted after it is gone from it, so a crash
+// at worst leaves a file behind that nothing refers to.
+static void run_batch(Save_Job_Array *batch) {
+        int ok = 1;
+        const Manifest *manifest = NULL;
+
+        for (size_t i = 0; i < batch->len; ++i) {
+                Save_Job *job = &batch->data[i];
+                size_t start = atomic_load(&g_save_done);
+
+                // Only the last version of a playlist is worth writing.
+                int skip = !job->write;
+                for (size_t j = i+1; j < batch->len && !skip; ++j) {
+                        const Save_Job *later = &batch->data[j];
+                        skip = later->write && later->id == job->id;
+                        for (size_t k = 0; k < later->removed.len && !skip; ++k) {
+                                skip = later->removed.data[k] == job->id;
                         }
-                        continue;
                 }
-
                 if (!skip) {
-                        // Keep lines that aren't part of the target playlist
-                        char *copy = strdup(current_line);
-                        if (!copy) {
-                                perror("strdup");
-                                display_temp_message("Memory allocation failed!");
-                                dyn_array_free(old_lines);
-                                dyn_array_free(new_lines);
-                                free(configfp);
-                                return 0;
-                        }
-                        dyn_array_append(new_lines, copy);
+                        ok &= write_playlist(job->id, job->name, &job->songfps);
                 }
+                atomic_store(&g_save_done, start + job->size);
+
+                if (job->has_manifest) manifest = &job->manifest;
         }
 
-        // Open file for writing
-        f = fopen(configfp, "w");
-        if (!f) {
-                perror("fopen");
-                display_temp_message("Failed to open config file for writing!");
-                free(configfp);
-                dyn_array_free(old_lines);
-                dyn_array_free(new_lines);
-                return 0;
+        if (manifest) ok &= write_manifest(manifest);
+
+        for (size_t i = 0; i < batch->len; ++i) {
+                for (size_t j = 0; j < batch->data[i].removed.len; ++j) {
+                        char *fp = get_playlist_fp(batch->data[i].removed.data[j]);
+                        (void)unlink(fp);
+                        free(fp);
+                }
         }
 
-        // Write new lines
-        for (size_t i = 0; i < new_lines.len; i++) {
-                if (fprintf(f, "%s\n", new_lines.data[i]) < 0) {
-                        perror("fprintf");
-                        display_temp_message("Error writing to config file!");
-                        fclose(f);
-                        free(configfp);
-                        dyn_array_free(old_lines);
-                        dyn_array_free(new_lines);
-                        return 0;
+        if (!ok) atomic_store(&g_save_failed, 1);
+}
+
+static void *save_main(void *arg) {
+        (void)arg;
+        pthread_mutex_lock(&g_save_lock);
+        while (1) {
+                while (g_pending.len == 0 && !g_save_quit) {
+                        pthread_cond_wait(&g_save_cond, &g_save_lock);
+                }
+                if (g_pending.len == 0) break;
+
+                // Take everything queued up so far, commit() can go on meanwhile.
+                Save_Job_Array batch = g_pending;
+                g_pending = dyn_array_empty(Save_Job_Array);
+                pthread_mutex_unlock(&g_save_lock);
+
+                run_batch(&batch);
+                for (size_t i = 0; i < batch.len; ++i) {
+                        free_job(&batch.data[i]);
+                }
+                dyn_array_free(batch);
+
+                pthread_mutex_lock(&g_save_lock);
+                if (g_pending.len == 0) {
+                        atomic_store(&g_save_total, 0);
+                        atomic_store(&g_save_done, 0);
                 }
         }
+        pthread_mutex_unlock(&g_save_lock);
+        return NULL;
+}
 
-        if (ferror(f)) {
-                perror("fwrite");
-                display_temp_message("Error writing to config file!");
-                fclose(f);
-                free(configfp);
-                dyn_array_free(old_lines);
-                dyn_array_free(new_lines);
-                return 0;
+// Apply a change to `g_saved` and hand it to the save thread.
+static int commit(Db_Record r) {
+        Save_Job job = {0};
+        apply_record(&r, &job);
+
+        pthread_mutex_lock(&g_save_lock);
+        if (!g_saver_running) {
+                g_saver_running = pthread_create(&g_saver, NULL, save_main, NULL) == 0;
+        }
+        if (g_saver_running) {
+                atomic_fetch_add(&g_save_total, job.size);
+                dyn_array_append(g_pending, job);
+                pthread_cond_signal(&g_save_cond);
         }
+        pthread_mutex_unlock(&g_save_lock);
 
-        fclose(f);
-        free(configfp);
-        dyn_array_free(old_lines);
-        dyn_array_free(new_lines);
+        if (!g_saver_running) {
+                Save_Job_Array batch = { .data = &job, .len = 1, .cap = 1 };
+                run_batch(&batch);
+                free_job(&job);
+                if (atomic_exchange(&g_save_failed, 0)) {
+                        display_temp_message("Failed to save playlists!");
+                        return 0;
+                }
+        }
+        return 1;
+}
+
+#define TEXT_CONFIG_MARKER "__ampire-playlist"
 
+// The next line of the text config in `*s`, `*n` long, without the '\n'.
+static int text_line(const char **p, const char *end, const char **s, size_t *n) {
+        if (*p >= end) return 0;
+        const char *nl = memchr(*p, '\n', end - *p);
+        *s = *p;
+        *n = (nl ? nl : end) - *p;
+        *p = nl ? nl + 1 : end;
         return 1;
 }
 
-void io_clear_config_file(void) {
-        char *configfp = get_config_fp();
-        FILE *f = fopen(configfp, "w");
-        if (!f) {
-                perror("fopen");
-                exit(0);
-        }
-        printf("Cleared saved music at: %s\n", configfp);
-        fclose(f);
-        free(configfp);
+static int is_text_marker(const char *s, size_t n) {
+        return n == sizeof(TEXT_CONFIG_MARKER) - 1 && !memcmp(s, TEXT_CONFIG_MARKER, n);
 }
 
-Playlist_Array io_read_config_file(void) {
-        Playlist_Array playlists; dyn_array_init_type(playlists);
+// Read the playlists from the old line based ~/.ampire:
+//   __ampire-playlist
+//   <name>
+//   <path>...
+// The file is mapped and gone over twice, once to count the songs
+// of every playlist and once to fill them in, so that each playlist
+// gets its songs in a single allocation.
+static int import_text_config(const char *fp) {
+        int fd = open(fp, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return 0;
 
-        char *configfp = get_config_fp();
+        struct stat st;
+        if (fstat(fd, &st) == -1 || st.st_size == 0) {
+                close(fd);
+                return 0;
+        }
 
-        FILE *f = fopen(configfp, "r");
-        if (!f) {
-                f = fopen(configfp, "w");
-                goto done;
+        const char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+                perror("mmap");
+                return 0;
         }
+        (void)madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
 
-        char *line = NULL;
-        size_t len = 0;
-        ssize_t read = 0;
-        int wait_playlist_name = 0;
-        ssize_t playlist_idx = -1;
-        while((read = getline(&line, &len, f)) != -1) {
-                if (!strcmp(line, "\n"))  continue;
-                if (line[read-1] == '\n') line[read-1] = '\0';
+        const char *end = map + st.st_size;
+        const char *p, *s;
+        size_t n;
+        int wait_playlist_name;
 
-                if (!strcmp(line, "__ampire-playlist")) {
+        Size_T_Array counts = dyn_array_empty(Size_T_Array);
+        p = map;
+        wait_playlist_name = 0;
+        while (text_line(&p, end, &s, &n)) {
+                if (n == 0) continue;
+                if (is_text_marker(s, n)) {
                         wait_playlist_name = 1;
                 } else if (wait_playlist_name) {
                         wait_playlist_name = 0;
-                        Playlist p = {
-                                .songfps = dyn_array_empty(Str_Array),
-                                .name = strdup(line),
-                                .from_cli = 0,
-                        };
-                        dyn_array_append(playlists, p);
-                        ++playlist_idx;
-                } else {
-                        dyn_array_append(playlists.data[playlist_idx].songfps, strdup(line));
+                        dyn_array_append(counts, 0);
+                } else if (counts.len > 0) {
+                        ++counts.data[counts.len-1];
                 }
         }
 
-        if (g_config.flags & FT_SHOW_SAVES) {
-            for (size_t i = 0; i < playlists.len; ++i) {
-                    printf("Playlist: %s:\n", playlists.data[i].name);
-                    for (size_t j = 0; j < playlists.data[i].songfps.len; ++j) {
-                            printf("  load: %s\n", playlists.data[i].songfps.data[j]);
-                    }
-            }
-            exit(0);
+        size_t first = g_saved.len;
+        p = map;
+        wait_playlist_name = 0;
+        while (text_line(&p, end, &s, &n)) {
+                if (n == 0) continue;
+                if (is_text_marker(s, n)) {
+                        wait_playlist_name = 1;
+                } else if (wait_playlist_name) {
+                        wait_playlist_name = 0;
+                        Str_Array songfps = dyn_array_empty(Str_Array);
+                        dyn_array_reserve(songfps, counts.data[g_saved.len - first]);
+                        dyn_array_append(g_saved, ((Saved_Playlist) {
+                                .id = g_next_id++,
+                                .name = arena_strndup(g_text, s, n),
+                                .loaded = 1,
+                                .songfps = songfps,
+                        }));
+                } else if (g_saved.len > first) {
+                        Str_Array *songfps = &g_saved.data[g_saved.len-1].songfps;
+                        songfps->data[songfps->len++] = intern_n(s, n);
+                }
         }
 
-        free(line);
-done:
-        free(configfp);
-        fclose(f);
-        return playlists;
+        dyn_array_free(counts);
+        munmap((void *)map, st.st_size);
+        return 1;
 }
 
-int io_del_playlist(const char *pname) {
-        if (!pname) {
-                display_temp_message("No playlist name provided!");
-                return 0;
+// Read the playlists from ~/.ampire.db and its journal, or from the
+// text ~/.ampire before that.
+static void import_old_config(void) {
+        Db         db;
+        Db_Journal journal;
+
+        char *dbfp = get_db_fp();
+        char *journalfp = get_journal_fp();
+        char *configfp = get_config_fp();
+
+        if (db_open(dbfp, &db)) {
+                for (size_t i = 0; i < db_len(&db); ++i) {
+                        Saved_Playlist p = {
+                                .id = g_next_id++,
+                                .name = (char *)db_name(&db, i),
+                                .loaded = 1,
+                                .songfps = dyn_array_empty(Str_Array),
+                        };
+                        db_songs(&db, i, &p.songfps);
+                        intern_songs(&p.songfps);
+                        p.name = arena_strdup(g_text, p.name);
+                        dyn_array_append(g_saved, p);
+                }
+                if (db_journal_open(journalfp, &journal)) {
+                        Db_Record r;
+                        while (db_journal_next(&journal, &r)) {
+                                if (r.seq <= db.seq) continue;
+                                r.name = arena_strdup(g_text, r.name);
+                                if (r.newname) r.newname = arena_strdup(g_text, r.newname);
+                                apply_record(&r, NULL);
+                        }
+                        db_journal_close(&journal);
+                }
+                db_close(&db);
+        } else {
+                (void)import_text_config(configfp);
         }
 
-        // Confirm deletion with user
-        char prompt[256];
-        snprintf(prompt, sizeof(prompt), "Delete playlist '%s'?", pname);
-        if (!prompt_yes_no(prompt)) {
-                return 0;
+        free(dbfp);
+        free(journalfp);
+        free(configfp);
+}
+
+// For --show-saves. The songs are printed right out of the mapped
+// file, they are never copied or interned.
+static void show_saved(const Saved_Playlist *p) {
+        printf("Playlist: %s:\n", p->name);
+        if (p->loaded) {
+                for (size_t j = 0; j < p->songfps.len; ++j) {
+                        printf("  load: %s\n", p->songfps.data[j]);
+                }
+                return;
         }
 
-        // Get config file path
-        char *configfp = get_config_fp();
-        if (!configfp) {
-                display_temp_message("Failed to get config file path!");
-                return 0;
+        Db db;
+        char *fp = get_playlist_fp(p->id);
+        if (db_open(fp, &db)) {
+                for (size_t j = 0; db_len(&db) > 0 && j < db_nsongs(&db, 0); ++j) {
+                        const char *song = db_song(&db, 0, j);
+                        if (song) printf("  load: %s\n", song);
+                }
+                db_close(&db);
         }
+        free(fp);
+}
+
+void io_write_to_config_file(const char *pname, const Str_Array *filepaths) {
+        (void)commit((Db_Record) {
+                .op = DB_OP_CREATE,
+                .name = strdup(pname),
+                .songfps = copy_songs(filepaths),
+        });
+}
 
-        // Open file for reading
-        FILE *f = fopen(configfp, "r");
-        if (!f) {
-                perror("fopen");
-                display_temp_message("Failed to open config file for reading!");
-                free(configfp);
+int io_replace_playlist_songs(const char *pname, const Str_Array *songfps) {
+        if (!pname || !songfps) {
+                display_temp_message("Invalid playlist name or song list!");
                 return 0;
         }
 
-        // Read all lines into a dynamic array
-        Str_Array old_lines = dyn_array_empty(Str_Array);
-        char *line = NULL;
-        size_t len = 0;
-        ssize_t read;
+        return commit((Db_Record) {
+                .op = DB_OP_REPLACE,
+                .name = find_saved(pname) ? pname : strdup(pname),
+                .songfps = copy_songs(songfps),
+        });
+}
 
-        while ((read = getline(&line, &len, f)) != -1) {
-                // Remove trailing newline if present
-                if (read > 0 && line[read - 1] == '\n') {
-                        line[read - 1] = '\0';
-                        read--;
-                }
-                // Skip empty lines when storing
-                if (read == 0 || !strcmp(line, "")) {
-                        continue;
-                }
-                // Duplicate line for storage
-                char *copy = strdup(line);
-                if (!copy) {
-                        perror("strdup");
-                        display_temp_message("Memory allocation failed!");
-                        fclose(f);
-                        free(line);
-                        free(configfp);
-                        dyn_array_free(old_lines);
-                        return 0;
-                }
-                dyn_array_append(old_lines, copy);
+int io_rename_playlist(const char *pname, const char *newname) {
+        if (!find_saved(pname)) return 1;
+        return commit((Db_Record) {
+                .op = DB_OP_RENAME,
+                .name = pname,
+                .newname = strdup(newname),
+        });
+}
+
+void io_clear_config_file(void) {
+        char *dir = get_store_fp(NULL);
+        (void)read_manifest();
+
+        Manifest empty = dyn_array_empty(Manifest);
+        if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+                perror(dir);
+                exit(0);
+        }
+        if (!write_manifest(&empty)) {
+                exit(0);
         }
+        for (size_t i = 0; i < g_saved.len; ++i) {
+                char *fp = get_playlist_fp(g_saved.data[i].id);
+                (void)unlink(fp);
+                free(fp);
+                dyn_array_free(g_saved.data[i].songfps);
+        }
+        // io_read_config_file() reads the empty manifest next.
+        dyn_array_clear(g_saved);
+        g_next_id = 1;
 
-        // Check for read errors
-        if (ferror(f)) {
-                perror("fread");
-                display_temp_message("Error reading config file!");
-                fclose(f);
-                free(line);
-                free(configfp);
-                dyn_array_free(old_lines);
-                return 0;
+        printf("Cleared saved music at: %s\n", dir);
+        free(dir);
+}
+
+int io_saving(size_t *done, size_t *total) {
+        *done = atomic_load(&g_save_done);
+        *total = atomic_load(&g_save_total);
+        return *total > 0;
+}
+
+int io_save_failed(void) {
+        return atomic_exchange(&g_save_failed, 0);
+}
+
+void io_finish(void) {
+        if (g_saver_running) {
+                pthread_mutex_lock(&g_save_lock);
+                g_save_quit = 1;
+                pthread_cond_signal(&g_save_cond);
+                pthread_mutex_unlock(&g_save_lock);
+                pthread_join(g_saver, NULL);
+                g_saver_running = 0;
         }
-        fclose(f);
-        free(line);
+}
 
-        // Filter out the target playlist
-        Str_Array new_lines = dyn_array_empty(Str_Array);
-        int skip = 0; // Flag to skip lines in the target playlist
-        int expect_name = 0; // Flag to expect playlist name after __ampire-playlist
+Playlist_Array io_read_config_file(void) {
+        Playlist_Array playlists; dyn_array_init_type(playlists);
 
-        for (size_t i = 0; i < old_lines.len; i++) {
-                char *current_line = old_lines.data[i];
+        char *dir = get_store_fp(NULL);
+        char *manifestfp = get_store_fp("manifest");
 
-                if (!strcmp(current_line, "__ampire-playlist")) {
-                        // Start of a new playlist
-                        skip = 0;
-                        expect_name = 1;
-                        dyn_array_append(new_lines, strdup(current_line));
-                        continue;
+        if (!g_text) g_text = arena_create();
+
+        if (!read_manifest()) {
+                struct stat st;
+                if (stat(manifestfp, &st) == 0) {
+                        // Keep it around instead of overwriting it.
+                        char badfp[1100];
+                        snprintf(badfp, sizeof(badfp), "%s.bad", manifestfp);
+                        fprintf(stderr, "%s is damaged, moving it to %s\n", manifestfp, badfp);
+                        (void)rename(manifestfp, badfp);
                 }
 
-                if (expect_name) {
-                        // This is the playlist name
-                        expect_name = 0;
-                        if (!strcmp(current_line, pname)) {
-                                // Target playlist found; skip it and its file paths
-                                skip = 1;
-                                // Remove the __ampire-playlist marker for this playlist
-                                dyn_array_rm_at(new_lines, new_lines.len - 1);
+                dyn_array_clear(g_saved);
+
+                if (stat(dir, &st) == 0) {
+                        // Only the manifest was lost, never touch the playlists.
+                        recover_manifest(dir);
+                        Manifest m = dyn_array_empty(Manifest);
+                        for (size_t i = 0; i < g_saved.len; ++i) {
+                                dyn_array_append(m, ((Manifest_Entry) {
+                                        .id = g_saved.data[i].id,
+                                        .name = g_saved.data[i].name,
+                                }));
+                        }
+                        (void)write_manifest(&m);
+                        dyn_array_free(m);
+                } else {
+                        // First run with a file per playlist, bring over the old ones.
+                        import_old_config();
+
+                        if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+                                perror(dir);
                         } else {
-                                // Keep the playlist name
-                                dyn_array_append(new_lines, strdup(current_line));
+                                Manifest m = dyn_array_empty(Manifest);
+                                int ok = 1;
+                                for (size_t i = 0; i < g_saved.len; ++i) {
+                                        const Saved_Playlist *p = &g_saved.data[i];
+                                        ok &= write_playlist(p->id, p->name, &p->songfps);
+                                        dyn_array_append(m, ((Manifest_Entry) { .id = p->id, .name = p->name }));
+                                }
+                                if (ok) (void)write_manifest(&m);
+                                dyn_array_free(m);
+                                atomic_store(&g_save_done, 0);
                         }
-                        continue;
                 }
+        }
 
-                if (!skip) {
-                        // Keep file paths or other lines not in the target playlist
-                        dyn_array_append(new_lines, strdup(current_line));
-                }
+        if (g_config.flags & FT_SHOW_SAVES) {
+            for (size_t i = 0; i < g_saved.len; ++i) {
+                    show_saved(&g_saved.data[i]);
+            }
+            exit(0);
         }
 
-        // Open file for writing
-        f = fopen(configfp, "w");
-        if (!f) {
-                perror("fopen");
-                display_temp_message("Failed to open config file for writing!");
-                free(configfp);
-                dyn_array_free(old_lines);
-                dyn_array_free(new_lines);
-                return 0;
+        for (size_t i = 0; i < g_saved.len; ++i) {
+                Arena *arena = arena_create();
+                dyn_array_append(playlists, ((Playlist) {
+                        .songfps = dyn_array_empty(Str_Array),
+                        .arena = arena,
+                        .name = arena_strdup(arena, g_saved.data[i].name),
+                        .from_cli = 0,
+                        .loaded = 0,
+                        .saved_id = g_saved.data[i].id,
+                        .scan = NULL,
+                        .scan_root = SCAN_NO_ROOT,
+                }));
         }
 
-        // Write filtered lines
-        for (size_t i = 0; i < new_lines.len; i++) {
-                if (fprintf(f, "%s\n", new_lines.data[i]) < 0) {
-                        perror("fprintf");
-                        display_temp_message("Error writing to config file!");
-                        fclose(f);
-                        free(configfp);
-                        dyn_array_free(old_lines);
-                        dyn_array_free(new_lines);
-                        return 0;
+        free(dir);
+        free(manifestfp);
+        return playlists;
+}
+
+void io_load_playlist(Playlist *p) {
+        if (p->loaded) return;
+        p->loaded = 1;
+
+        for (size_t i = 0; i < g_saved.len; ++i) {
+                if (g_saved.data[i].id == p->saved_id) {
+                        p->songfps = copy_songs(saved_songs(&g_saved.data[i]));
+                        return;
                 }
         }
+}
 
-        // Check for write errors
-        if (ferror(f)) {
-                perror("fwrite");
-                display_temp_message("Error writing to config file!");
-                fclose(f);
-                free(configfp);
-                dyn_array_free(old_lines);
-                dyn_array_free(new_lines);
+int io_del_playlist(const char *pname) {
+        if (!pname) {
+                display_temp_message("No playlist name provided!");
                 return 0;
         }
 
-        fclose(f);
-        free(configfp);
-
-        dyn_array_free(old_lines);
-        dyn_array_free(new_lines);
+        // Confirm deletion with user
+        char prompt[256];
+        snprintf(prompt, sizeof(prompt), "Delete playlist '%s'?", pname);
+        if (!prompt_yes_no(prompt)) {
+                return 0;
+        }
 
-        return 1;
+        if (!find_saved(pname)) return 1;
+        return commit((Db_Record) {
+                .op = DB_OP_DELETE,
+                .name = pname,
+        });
 }
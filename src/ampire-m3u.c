@@ -0,0 +1,179 @@
+#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ampire-m3u.h"
+#include "ampire-intern.h"
+#include "ampire-scan.h"
+#include "dyn_array.h"
+#include "ds/array.h"
+
+static int has_ext(const char *fp, const char *ext) {
+        const char *dot = strrchr(fp, '.');
+        return dot && !strcasecmp(dot, ext);
+}
+
+int m3u_is_playlist(const char *fp) {
+        return has_ext(fp, ".m3u") || has_ext(fp, ".m3u8") || has_ext(fp, ".pls");
+}
+
+// `rel` put after the first `baselen` characters of `base`, into `out`.
+// This is only done on the strings, a realpath() for every song is what
+// makes long playlists slow to read. Returns 0 if it does not fit.
+static int join_rel(char *out, size_t cap, const char *base, size_t baselen, const char *rel) {
+        while (1) {
+                if (rel[0] == '.' && rel[1] == '/') {
+                        rel += 2;
+                } else if (rel[0] == '.' && rel[1] == '.' && rel[2] == '/') {
+                        rel += 3;
+                        while (baselen > 0 && base[baselen-1] != '/') --baselen;
+                        if (baselen > 0) --baselen;
+                } else {
+                        break;
+                }
+        }
+
+        size_t n = strlen(rel);
+        if (baselen + 1 + n + 1 > cap) return 0;
+        memcpy(out, base, baselen);
+        out[baselen] = '/';
+        memcpy(out + baselen + 1, rel, n + 1);
+        return 1;
+}
+
+static int hexval(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+}
+
+// Undo the %XX of a file:// URL. It only gets shorter, so in place.
+static void percent_decode(char *s) {
+        char *out = s;
+        for (; *s; ++s) {
+                int hi, lo;
+                if (s[0] == '%' && (hi = hexval(s[1])) != -1 && (lo = hexval(s[2])) != -1) {
+                        *out++ = (char)(hi * 16 + lo);
+                        s += 2;
+                } else {
+                        *out++ = *s;
+                }
+        }
+        *out = '\0';
+}
+
+int m3u_read(const char *fp, Str_Array *out) {
+        int fd = open(fp, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+                perror(fp);
+                return 0;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+                perror("fstat");
+                close(fd);
+                return 0;
+        }
+        if (st.st_size == 0) {
+                close(fd);
+                return 1;
+        }
+
+        const char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+                perror("mmap");
+                return 0;
+        }
+        (void)madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+
+        const int pls = has_ext(fp, ".pls");
+        const char *slash = strrchr(fp, '/');
+        const size_t baselen = slash ? (size_t)(slash - fp) : 0;
+
+        const char *p = map, *end = map + st.st_size;
+        if (end - p >= 3 && !memcmp(p, "\xef\xbb\xbf", 3)) {
+                p += 3;
+        }
+
+        char line[PATH_MAX], path[PATH_MAX];
+        while (p < end) {
+                const char *nl = memchr(p, '\n', end - p);
+                const char *s = p, *e = nl ? nl : end;
+                p = nl ? nl + 1 : end;
+
+                while (s < e && isspace((unsigned char)*s)) ++s;
+                while (e > s && isspace((unsigned char)e[-1])) --e;
+                if (s == e) continue;
+
+                if (pls) {
+                        // Only the FileN=<path> lines, the rest is titles and lengths.
+                        if (e - s < 5 || strncasecmp(s, "File", 4)) continue;
+                        const char *q = s + 4;
+                        while (q < e && isdigit((unsigned char)*q)) ++q;
+                        if (q == s + 4 || q == e || *q != '=') continue;
+                        s = q + 1;
+                } else if (*s == '#') {
+                        continue;
+                }
+
+                if ((size_t)(e - s) >= sizeof(line)) continue;
+                memcpy(line, s, e - s);
+                line[e - s] = '\0';
+
+                char *song = line;
+                if (!strncmp(song, "file://", 7)) {
+                        song += 7;
+                        percent_decode(song);
+                } else if (strstr(song, "://")) {
+                        continue; // A stream, not something we can play
+                }
+                if (!is_music_f(song)) continue;
+
+                if (*song != '/') {
+                        if (!join_rel(path, sizeof(path), fp, baselen, song)) continue;
+                        song = path;
+                }
+                dyn_array_append(*out, intern(song));
+        }
+
+        munmap((void *)map, st.st_size);
+        return 1;
+}
+
+int m3u_write(const char *fp, const Str_Array *songfps) {
+        FILE *f = fopen(fp, "w");
+        if (!f) {
+                perror(fp);
+                return 0;
+        }
+        setvbuf(f, NULL, _IOFBF, 64 * 1024);
+
+        if (has_ext(fp, ".pls")) {
+                fprintf(f, "[playlist]\n");
+                for (size_t i = 0; i < songfps->len; ++i) {
+                        fprintf(f, "File%zu=%s\n", i+1, songfps->data[i]);
+                }
+                fprintf(f, "NumberOfEntries=%zu\nVersion=2\n", songfps->len);
+        } else {
+                fprintf(f, "#EXTM3U\n");
+                for (size_t i = 0; i < songfps->len; ++i) {
+                        fputs(songfps->data[i], f);
+                        fputc('\n', f);
+                }
+        }
+
+        int ok = !ferror(f);
+        if (fclose(f) != 0) ok = 0;
+        if (!ok) perror(fp);
+        return ok;
+}
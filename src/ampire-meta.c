@@ -0,0 +1,757 @@
+#include <assert.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ampire-meta.h"
+#include "ampire-intern.h"
+#include "dyn_array.h"
+#include "ds/array.h"
+#include "ds/arena.h"
+
+#define META_MAX_THREADS 8
+
+// Tags we care about are short, anything bigger
+// is cover art or lyrics and is skipped.
+#define META_MAX_FIELD (16 * 1024)
+
+// Ogg headers with cover art in them can be huge,
+// only this much of the comment packet is looked at.
+#define META_MAX_PACKET (64 * 1024)
+
+#define META_BUF_SZ 8192
+
+//////////////////////////////////////////////////
+// Reading
+
+// A tiny read cache so that walking over the small
+// frames of a tag does not cost a pread() each.
+typedef struct {
+        int      fd;
+        off_t    size;
+        off_t    off; // File offset of `buf`
+        size_t   len;
+        uint8_t  buf[META_BUF_SZ];
+} Meta_File;
+
+static int mf_read(Meta_File *f, off_t pos, void *dst, size_t n) {
+        if (pos < 0 || pos + (off_t)n > f->size) return 0;
+
+        if (n > META_BUF_SZ) {
+                return pread(f->fd, dst, n, pos) == (ssize_t)n;
+        }
+
+        if (pos < f->off || pos + (off_t)n > f->off + (off_t)f->len) {
+                ssize_t got = pread(f->fd, f->buf, META_BUF_SZ, pos);
+                if (got < (ssize_t)n) return 0;
+                f->off = pos;
+                f->len = (size_t)got;
+        }
+
+        memcpy(dst, f->buf + (pos - f->off), n);
+        return 1;
+}
+
+static uint32_t be32(const uint8_t *p) {
+        return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint32_t le32(const uint8_t *p) {
+        return (uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0];
+}
+
+static uint64_t le64(const uint8_t *p) {
+        return (uint64_t)le32(p+4) << 32 | le32(p);
+}
+
+static uint32_t syncsafe(const uint8_t *p) {
+        return (uint32_t)(p[0] & 0x7f) << 21 | (uint32_t)(p[1] & 0x7f) << 14 | (uint32_t)(p[2] & 0x7f) << 7 | (p[3] & 0x7f);
+}
+
+//////////////////////////////////////////////////
+// Strings
+
+// Copy `n` bytes of text, without trailing spaces and NULs.
+static char *text_dup(const char *s, size_t n) {
+        while (n > 0 && (s[n-1] == '\0' || s[n-1] == ' ')) --n;
+        size_t start = 0;
+        while (start < n && s[start] == ' ') ++start;
+        if (start == n) return NULL;
+        char *p = malloc(n - start + 1);
+        memcpy(p, s + start, n - start);
+        p[n - start] = '\0';
+        return p;
+}
+
+static size_t utf8_put(char *out, uint32_t c) {
+        if (c < 0x80) {
+                out[0] = c;
+                return 1;
+        } else if (c < 0x800) {
+                out[0] = 0xc0 | (c >> 6);
+                out[1] = 0x80 | (c & 0x3f);
+                return 2;
+        } else if (c < 0x10000) {
+                out[0] = 0xe0 | (c >> 12);
+                out[1] = 0x80 | ((c >> 6) & 0x3f);
+                out[2] = 0x80 | (c & 0x3f);
+                return 3;
+        }
+        out[0] = 0xf0 | (c >> 18);
+        out[1] = 0x80 | ((c >> 12) & 0x3f);
+        out[2] = 0x80 | ((c >> 6) & 0x3f);
+        out[3] = 0x80 | (c & 0x3f);
+        return 4;
+}
+
+static char *latin1_dup(const uint8_t *s, size_t n) {
+        char *tmp = malloc(n*2 + 1);
+        size_t len = 0;
+        for (size_t i = 0; i < n && s[i]; ++i) {
+                len += utf8_put(tmp + len, s[i]);
+        }
+        char *res = text_dup(tmp, len);
+        free(tmp);
+        return res;
+}
+
+static char *utf16_dup(const uint8_t *s, size_t n, int big_endian) {
+        if (n >= 2 && ((s[0] == 0xff && s[1] == 0xfe) || (s[0] == 0xfe && s[1] == 0xff))) {
+                big_endian = s[0] == 0xfe;
+                s += 2;
+                n -= 2;
+        }
+
+        char *tmp = malloc(n*2 + 1);
+        size_t len = 0;
+        for (size_t i = 0; i + 1 < n; i += 2) {
+                uint32_t c = big_endian ? (s[i] << 8 | s[i+1]) : (s[i+1] << 8 | s[i]);
+                if (c == 0) break;
+                if (c >= 0xd800 && c < 0xdc00 && i + 3 < n) {
+                        uint32_t lo = big_endian ? (s[i+2] << 8 | s[i+3]) : (s[i+3] << 8 | s[i+2]);
+                        if (lo >= 0xdc00 && lo < 0xe000) {
+                                c = 0x10000 + ((c - 0xd800) << 10) + (lo - 0xdc00);
+                                i += 2;
+                        }
+                }
+                len += utf8_put(tmp + len, c);
+        }
+        char *res = text_dup(tmp, len);
+        free(tmp);
+        return res;
+}
+
+// "3/12" -> 3
+static int parse_trackno(const char *s) {
+        if (!s) return 0;
+        int n = atoi(s);
+        return n > 0 ? n : 0;
+}
+
+static void set_field(char **dst, char *s) {
+        if (*dst || !s) {
+                free(s);
+        } else {
+                *dst = s;
+        }
+}
+
+//////////////////////////////////////////////////
+// ID3
+
+// Decode the body of an ID3v2 text frame.
+static char *id3_text(const uint8_t *d, size_t n) {
+        if (n < 1) return NULL;
+        switch (d[0]) {
+        case 0:  return latin1_dup(d+1, n-1);
+        case 1:  return utf16_dup(d+1, n-1, 0);
+        case 2:  return utf16_dup(d+1, n-1, 1);
+        case 3:  return text_dup((const char *)d+1, strnlen((const char *)d+1, n-1));
+        default: return NULL;
+        }
+}
+
+// Returns the offset where the audio starts.
+static off_t read_id3v2(Meta_File *f, Meta *m, int *length_ms) {
+        uint8_t h[10];
+        if (!mf_read(f, 0, h, 10) || memcmp(h, "ID3", 3)) return 0;
+
+        int ver = h[3];
+        int flags = h[5];
+        off_t end = 10 + (off_t)syncsafe(h+6);
+        off_t audio = end + ((flags & 0x10) ? 10 : 0);
+        off_t pos = 10;
+
+        if (ver < 2 || ver > 4) return audio;
+
+        // Skip the extended header.
+        if ((flags & 0x40) && ver > 2) {
+                uint8_t e[4];
+                if (!mf_read(f, pos, e, 4)) return audio;
+                pos += ver == 4 ? (off_t)syncsafe(e) : 4 + (off_t)be32(e);
+        }
+
+        const size_t hdr = ver == 2 ? 6 : 10;
+        while (pos + (off_t)hdr <= end) {
+                uint8_t fh[10];
+                if (!mf_read(f, pos, fh, hdr) || fh[0] == 0) break;
+
+                char id[5] = {0};
+                uint32_t sz;
+                if (ver == 2) {
+                        memcpy(id, fh, 3);
+                        sz = (uint32_t)fh[3] << 16 | (uint32_t)fh[4] << 8 | fh[5];
+                } else {
+                        memcpy(id, fh, 4);
+                        sz = ver == 4 ? syncsafe(fh+4) : be32(fh+4);
+                }
+
+                off_t body = pos + hdr;
+                pos = body + sz;
+                if (sz == 0 || sz > META_MAX_FIELD || pos > end) continue;
+
+                char **dst = NULL;
+                int is_track = 0, is_len = 0;
+                if (!strcmp(id, "TIT2") || !strcmp(id, "TT2")) dst = &m->title;
+                else if (!strcmp(id, "TPE1") || !strcmp(id, "TP1")) dst = &m->artist;
+                else if (!strcmp(id, "TALB") || !strcmp(id, "TAL")) dst = &m->album;
+                else if (!strcmp(id, "TRCK") || !strcmp(id, "TRK")) is_track = 1;
+                else if (!strcmp(id, "TLEN") || !strcmp(id, "TLE")) is_len = 1;
+                else continue;
+
+                uint8_t *d = malloc(sz);
+                if (mf_read(f, body, d, sz)) {
+                        char *s = id3_text(d, sz);
+                        if (dst) {
+                                set_field(dst, s);
+                        } else {
+                                if (is_track && !m->trackno) m->trackno = parse_trackno(s);
+                                if (is_len && s) *length_ms = atoi(s);
+                                free(s);
+                        }
+                }
+                free(d);
+        }
+
+        return audio;
+}
+
+// Returns 1 if there is an ID3v1 tag at the end of the file.
+static int read_id3v1(Meta_File *f, Meta *m) {
+        uint8_t t[128];
+        if (f->size < 128 || !mf_read(f, f->size - 128, t, 128) || memcmp(t, "TAG", 3)) {
+                return 0;
+        }
+
+        set_field(&m->title, latin1_dup(t+3, 30));
+        set_field(&m->artist, latin1_dup(t+33, 30));
+        set_field(&m->album, latin1_dup(t+63, 30));
+        // ID3v1.1 puts the track number in the last byte of the comment.
+        if (!m->trackno && t[125] == 0 && t[126] != 0) {
+                m->trackno = t[126];
+        }
+        return 1;
+}
+
+//////////////////////////////////////////////////
+// MP3
+
+static const int mp3_bitrates[2][3][16] = {
+        { // MPEG 1, layers I, II, III
+                {0,32,64,96,128,160,192,224,256,288,320,352,384,416,448,0},
+                {0,32,48,56,64,80,96,112,128,160,192,224,256,320,384,0},
+                {0,32,40,48,56,64,80,96,112,128,160,192,224,256,320,0},
+        },
+        { // MPEG 2 and 2.5
+                {0,32,48,56,64,80,96,112,128,144,160,176,192,224,256,0},
+                {0,8,16,24,32,40,48,56,64,80,96,112,128,144,160,0},
+                {0,8,16,24,32,40,48,56,64,80,96,112,128,144,160,0},
+        },
+};
+
+static const int mp3_rates[3] = {44100, 48000, 32000};
+
+static int mp3_duration(Meta_File *f, off_t audio, off_t audio_end) {
+        // Find the first frame, there may be some junk before it.
+        uint8_t b[4];
+        off_t pos = audio;
+        const off_t limit = audio + 64 * 1024;
+        for (; pos < limit; ++pos) {
+                if (!mf_read(f, pos, b, 4)) return -1;
+                if (b[0] != 0xff || (b[1] & 0xe0) != 0xe0) continue;
+                int v = (b[1] >> 3) & 3, l = (b[1] >> 1) & 3;
+                int bi = b[2] >> 4, ri = (b[2] >> 2) & 3;
+                if (v != 1 && l != 0 && bi != 0 && bi != 15 && ri != 3) break;
+        }
+        if (pos >= limit) return -1;
+
+        int version = (b[1] >> 3) & 3; // 3 = MPEG 1, 2 = MPEG 2, 0 = MPEG 2.5
+        int layer = 4 - ((b[1] >> 1) & 3);
+        int mpeg1 = version == 3;
+        int bitrate = mp3_bitrates[!mpeg1][layer-1][b[2] >> 4];
+        int rate = mp3_rates[(b[2] >> 2) & 3] >> (mpeg1 ? 0 : version == 2 ? 1 : 2);
+        int mono = (b[3] >> 6) == 3;
+        int spf = layer == 1 ? 384 : (layer == 3 && !mpeg1) ? 576 : 1152;
+
+        // A VBR file says how many frames it has in its first frame.
+        uint8_t x[18];
+        off_t xing = pos + 4 + (mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17));
+        if (mf_read(f, xing, x, 12) && (!memcmp(x, "Xing", 4) || !memcmp(x, "Info", 4)) && (be32(x+4) & 1)) {
+                return (int)((uint64_t)be32(x+8) * spf / rate);
+        }
+        if (mf_read(f, pos + 36, x, 18) && !memcmp(x, "VBRI", 4)) {
+                return (int)((uint64_t)be32(x+14) * spf / rate);
+        }
+
+        // Otherwise assume a constant bitrate.
+        return (int)((uint64_t)(audio_end - pos) * 8 / ((uint64_t)bitrate * 1000));
+}
+
+static int read_mp3(Meta_File *f, Meta *m) {
+        int length_ms = -1;
+        off_t audio = read_id3v2(f, m, &length_ms);
+        int has_v1 = read_id3v1(f, m);
+
+        if (length_ms > 0) {
+                m->duration = length_ms / 1000;
+        } else {
+                m->duration = mp3_duration(f, audio, f->size - (has_v1 ? 128 : 0));
+        }
+
+        return audio > 0 || has_v1 || m->duration >= 0;
+}
+
+//////////////////////////////////////////////////
+// Ogg (Vorbis and Opus)
+
+// Collect the first `npackets` packets of the first
+// stream. Each one is cut off at META_MAX_PACKET.
+static int ogg_packets(Meta_File *f, Str_Array *packets, Size_T_Array *lens, size_t npackets) {
+        off_t pos = 0;
+        uint32_t serial = 0;
+        char *cur = NULL;
+        size_t curlen = 0;
+
+        while (packets->len < npackets) {
+                uint8_t h[27 + 255];
+                if (!mf_read(f, pos, h, 27) || memcmp(h, "OggS", 4)) break;
+                int nsegs = h[26];
+                if (!mf_read(f, pos + 27, h + 27, nsegs)) break;
+
+                if (pos == 0) serial = le32(h+14);
+                off_t data = pos + 27 + nsegs;
+                pos = data;
+                for (int i = 0; i < nsegs; ++i) pos += h[27+i];
+                if (le32(h+14) != serial) continue;
+
+                off_t seg = data;
+                for (int i = 0; i < nsegs && packets->len < npackets; ++i) {
+                        size_t n = h[27+i];
+                        if (!cur) {
+                                cur = malloc(META_MAX_PACKET);
+                                curlen = 0;
+                        }
+                        size_t take = curlen + n > META_MAX_PACKET ? META_MAX_PACKET - curlen : n;
+                        if (take > 0 && !mf_read(f, seg, cur + curlen, take)) goto fail;
+                        curlen += take;
+                        seg += n;
+                        if (n < 255) {
+                                dyn_array_append(*packets, cur);
+                                dyn_array_append(*lens, curlen);
+                                cur = NULL;
+                        }
+                }
+        }
+
+        free(cur);
+        return packets->len == npackets;
+
+ fail:
+        free(cur);
+        return 0;
+}
+
+static int64_t ogg_last_granule(Meta_File *f) {
+        const size_t n = f->size < 64 * 1024 ? (size_t)f->size : 64 * 1024;
+        uint8_t *tail = malloc(n);
+        int64_t granule = -1;
+        if (mf_read(f, f->size - n, tail, n)) {
+                for (size_t i = n >= 27 ? n - 27 : 0; i-- > 0;) {
+                        if (!memcmp(tail+i, "OggS", 4) && tail[i+4] == 0) {
+                                granule = (int64_t)le64(tail+i+6);
+                                if (granule >= 0) break;
+                        }
+                }
+        }
+        free(tail);
+        return granule;
+}
+
+static void vorbis_comments(const uint8_t *p, size_t n, Meta *m) {
+        if (n < 4) return;
+        size_t pos = 4 + (size_t)le32(p);
+        if (pos + 4 > n) return;
+        uint32_t count = le32(p + pos);
+        pos += 4;
+
+        for (uint32_t i = 0; i < count && pos + 4 <= n; ++i) {
+                size_t len = le32(p + pos);
+                pos += 4;
+                if (len > n - pos) break;
+
+                const char *c = (const char *)p + pos;
+                const char *eq = memchr(c, '=', len);
+                pos += len;
+                if (!eq) continue;
+
+                size_t klen = eq - c;
+                char *val = text_dup(eq + 1, len - klen - 1);
+                if (klen == 5 && !strncasecmp(c, "TITLE", 5)) set_field(&m->title, val);
+                else if (klen == 6 && !strncasecmp(c, "ARTIST", 6)) set_field(&m->artist, val);
+                else if (klen == 5 && !strncasecmp(c, "ALBUM", 5)) set_field(&m->album, val);
+                else {
+                        if (klen == 11 && !strncasecmp(c, "TRACKNUMBER", 11) && !m->trackno) {
+                                m->trackno = parse_trackno(val);
+                        }
+                        free(val);
+                }
+        }
+}
+
+static int read_ogg(Meta_File *f, Meta *m) {
+        Str_Array packets = dyn_array_empty(Str_Array);
+        Size_T_Array lens = dyn_array_empty(Size_T_Array);
+        int ok = 0;
+
+        if (!ogg_packets(f, &packets, &lens, 2)) goto done;
+
+        const uint8_t *id = (const uint8_t *)packets.data[0];
+        const uint8_t *tags = (const uint8_t *)packets.data[1];
+        int64_t granule = ogg_last_granule(f);
+
+        if (lens.data[0] >= 16 && !memcmp(id, "\x01vorbis", 7)) {
+                uint32_t rate = le32(id+12);
+                if (lens.data[1] > 7 && !memcmp(tags, "\x03vorbis", 7)) {
+                        vorbis_comments(tags+7, lens.data[1]-7, m);
+                }
+                if (granule >= 0 && rate > 0) m->duration = (int)(granule / rate);
+                ok = 1;
+        } else if (lens.data[0] >= 19 && !memcmp(id, "OpusHead", 8)) {
+                // Opus always runs at 48kHz, no matter the input rate.
+                int64_t preskip = id[10] | id[11] << 8;
+                if (lens.data[1] > 8 && !memcmp(tags, "OpusTags", 8)) {
+                        vorbis_comments(tags+8, lens.data[1]-8, m);
+                }
+                if (granule >= preskip) m->duration = (int)((granule - preskip) / 48000);
+                ok = 1;
+        }
+
+ done:
+        for (size_t i = 0; i < packets.len; ++i) {
+                free(packets.data[i]);
+        }
+        dyn_array_free(packets);
+        dyn_array_free(lens);
+        return ok;
+}
+
+//////////////////////////////////////////////////
+// WAV
+
+static void riff_info(Meta_File *f, off_t pos, off_t end, Meta *m) {
+        while (pos + 8 <= end) {
+                uint8_t h[8];
+                if (!mf_read(f, pos, h, 8)) return;
+                uint32_t sz = le32(h+4);
+                off_t body = pos + 8;
+                pos = body + sz + (sz & 1);
+                if (sz == 0 || sz > META_MAX_FIELD) continue;
+
+                char **dst = NULL;
+                if (!memcmp(h, "INAM", 4)) dst = &m->title;
+                else if (!memcmp(h, "IART", 4)) dst = &m->artist;
+                else if (!memcmp(h, "IPRD", 4)) dst = &m->album;
+                else if (memcmp(h, "ITRK", 4) && memcmp(h, "IPRT", 4)) continue;
+
+                char *d = malloc(sz);
+                if (mf_read(f, body, d, sz)) {
+                        char *s = latin1_dup((uint8_t *)d, sz);
+                        if (dst) {
+                                set_field(dst, s);
+                        } else {
+                                if (!m->trackno) m->trackno = parse_trackno(s);
+                                free(s);
+                        }
+                }
+                free(d);
+        }
+}
+
+static int read_wav(Meta_File *f, Meta *m) {
+        uint8_t h[12];
+        if (!mf_read(f, 0, h, 12) || memcmp(h, "RIFF", 4) || memcmp(h+8, "WAVE", 4)) return 0;
+
+        uint32_t byte_rate = 0;
+        uint64_t data_sz = 0;
+        off_t pos = 12;
+        // The data chunk is only skipped over, the tags may come after it.
+        for (int i = 0; i < 64 && pos + 8 <= f->size; ++i) {
+                uint8_t c[12];
+                if (!mf_read(f, pos, c, 8)) break;
+                uint32_t sz = le32(c+4);
+                off_t body = pos + 8;
+
+                if (!memcmp(c, "fmt ", 4) && sz >= 16) {
+                        uint8_t fmt[16];
+                        if (mf_read(f, body, fmt, 16)) byte_rate = le32(fmt+8);
+                } else if (!memcmp(c, "data", 4)) {
+                        data_sz = sz;
+                } else if (!memcmp(c, "LIST", 4) && sz >= 4) {
+                        if (mf_read(f, body, c+8, 4) && !memcmp(c+8, "INFO", 4)) {
+                                riff_info(f, body + 4, body + sz, m);
+                        }
+                }
+
+                pos = body + sz + (sz & 1);
+        }
+
+        if (byte_rate > 0 && data_sz > 0) {
+                m->duration = (int)(data_sz / byte_rate);
+        }
+        return 1;
+}
+
+//////////////////////////////////////////////////
+
+int meta_read(const char *path, Meta *out) {
+        *out = (Meta) {
+                .title = NULL,
+                .artist = NULL,
+                .album = NULL,
+                .trackno = 0,
+                .duration = -1,
+        };
+
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return 0;
+
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+                close(fd);
+                return 0;
+        }
+
+        Meta_File *f = malloc(sizeof(Meta_File));
+        f->fd = fd;
+        f->size = st.st_size;
+        f->off = 0;
+        f->len = 0;
+
+        // Go by the contents, the extension might be lying.
+        uint8_t magic[4] = {0};
+        int ok = 0;
+        if (mf_read(f, 0, magic, 4)) {
+                if (!memcmp(magic, "OggS", 4))      ok = read_ogg(f, out);
+                else if (!memcmp(magic, "RIFF", 4)) ok = read_wav(f, out);
+                else                                ok = read_mp3(f, out);
+        }
+
+        close(fd);
+        free(f);
+        return ok;
+}
+
+void meta_clear(Meta *m) {
+        free(m->title);
+        free(m->artist);
+        free(m->album);
+        m->title = m->artist = m->album = NULL;
+}
+
+//////////////////////////////////////////////////
+// Store
+
+Meta_Store meta_store_create(void) {
+        return (Meta_Store) {
+                .titles = dyn_array_empty(Str_Array),
+                .artists = dyn_array_empty(Str_Array),
+                .albums = dyn_array_empty(Str_Array),
+                .tracknos = dyn_array_empty(Int_Array),
+                .durations = dyn_array_empty(Int_Array),
+        };
+}
+
+void meta_store_append(Meta_Store *ms) {
+        dyn_array_append(ms->titles, NULL);
+        dyn_array_append(ms->artists, NULL);
+        dyn_array_append(ms->albums, NULL);
+        dyn_array_append(ms->tracknos, 0);
+        dyn_array_append(ms->durations, -1);
+}
+
+void meta_store_filter(Meta_Store *ms, const uint8_t *rm) {
+        dyn_array_filter(ms->titles, i, !rm[i]);
+        dyn_array_filter(ms->artists, i, !rm[i]);
+        dyn_array_filter(ms->albums, i, !rm[i]);
+        dyn_array_filter(ms->tracknos, i, !rm[i]);
+        dyn_array_filter(ms->durations, i, !rm[i]);
+}
+
+void meta_store_set(Meta_Store *ms, size_t idx, const Meta *m, Arena *arena) {
+        assert(idx < ms->titles.len);
+        ms->titles.data[idx] = m->title ? arena_strdup(arena, m->title) : NULL;
+        ms->artists.data[idx] = m->artist ? arena_strdup(arena, m->artist) : NULL;
+        ms->albums.data[idx] = m->album ? arena_strdup(arena, m->album) : NULL;
+        ms->tracknos.data[idx] = m->trackno;
+        ms->durations.data[idx] = m->duration;
+}
+
+void meta_store_free(Meta_Store *ms) {
+        dyn_array_free(ms->titles);
+        dyn_array_free(ms->artists);
+        dyn_array_free(ms->albums);
+        dyn_array_free(ms->tracknos);
+        dyn_array_free(ms->durations);
+}
+
+//////////////////////////////////////////////////
+// Pipeline
+
+typedef struct {
+        void       *owner;
+        const char *path;
+        size_t      idx;
+} Meta_Request;
+
+DYN_ARRAY_TYPE(Meta_Request, Meta_Request_Array);
+
+struct Meta_Pipeline {
+        pthread_mutex_t     lock;
+        pthread_cond_t      cond;
+        Meta_Request_Array  requests;
+        size_t              head;     // Next request to hand to a worker
+        Meta_Result_Array   results;
+        int                 stop;
+        pthread_t          *threads;
+        size_t              nthreads;
+};
+
+static void *meta_worker(void *arg) {
+        Meta_Pipeline *p = (Meta_Pipeline *)arg;
+
+        pthread_mutex_lock(&p->lock);
+        while (1) {
+                while (!p->stop && p->head == p->requests.len) {
+                        pthread_cond_wait(&p->cond, &p->lock);
+                }
+                if (p->stop) break;
+
+                Meta_Request r = p->requests.data[p->head++];
+                if (p->head == p->requests.len) {
+                        p->requests.len = p->head = 0;
+                }
+                pthread_mutex_unlock(&p->lock);
+
+                Meta_Result res = { .owner = r.owner, .path = r.path, .idx = r.idx };
+                (void)meta_read(r.path, &res.meta);
+
+                pthread_mutex_lock(&p->lock);
+                dyn_array_append(p->results, res);
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        return NULL;
+}
+
+Meta_Pipeline *meta_pipeline_create(void) {
+        Meta_Pipeline *p = malloc(sizeof(Meta_Pipeline));
+        pthread_mutex_init(&p->lock, NULL);
+        pthread_cond_init(&p->cond, NULL);
+        p->requests = dyn_array_empty(Meta_Request_Array);
+        p->head = 0;
+        p->results = dyn_array_empty(Meta_Result_Array);
+        p->stop = 0;
+
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        size_t n = ncpu < 1 ? 1 : (size_t)ncpu;
+        if (n > META_MAX_THREADS) n = META_MAX_THREADS;
+
+        p->threads = malloc(sizeof(pthread_t) * n);
+        p->nthreads = 0;
+        for (size_t i = 0; i < n; ++i) {
+                if (pthread_create(&p->threads[p->nthreads], NULL, meta_worker, p) == 0) {
+                        ++p->nthreads;
+                }
+        }
+
+        return p;
+}
+
+void meta_request(Meta_Pipeline *p, void *owner, const Str_Array *paths, size_t from) {
+        if (!p || from >= paths->len) return;
+
+        pthread_mutex_lock(&p->lock);
+        for (size_t i = from; i < paths->len; ++i) {
+                dyn_array_append(p->requests, ((Meta_Request) {
+                        .owner = owner,
+                        .path = intern_ref(paths->data[i]),
+                        .idx = i,
+                }));
+        }
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+}
+
+void meta_poll(Meta_Pipeline *p, Meta_Result_Array *out) {
+        if (!p) return;
+
+        // Only take what is there, never wait on the workers.
+        if (pthread_mutex_trylock(&p->lock) != 0) return;
+        for (size_t i = 0; i < p->results.len; ++i) {
+                dyn_array_append(*out, p->results.data[i]);
+        }
+        p->results.len = 0;
+        pthread_mutex_unlock(&p->lock);
+}
+
+size_t meta_pending(Meta_Pipeline *p) {
+        if (!p) return 0;
+        pthread_mutex_lock(&p->lock);
+        size_t n = p->requests.len - p->head;
+        pthread_mutex_unlock(&p->lock);
+        return n;
+}
+
+void meta_pipeline_free(Meta_Pipeline *p) {
+        if (!p) return;
+
+        pthread_mutex_lock(&p->lock);
+        p->stop = 1;
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+
+        for (size_t i = 0; i < p->nthreads; ++i) {
+                pthread_join(p->threads[i], NULL);
+        }
+
+        for (size_t i = p->head; i < p->requests.len; ++i) {
+                intern_unref(p->requests.data[i].path);
+        }
+        for (size_t i = 0; i < p->results.len; ++i) {
+                intern_unref(p->results.data[i].path);
+                meta_clear(&p->results.data[i].meta);
+        }
+        dyn_array_free(p->requests);
+        dyn_array_free(p->results);
+        pthread_cond_destroy(&p->cond);
+        pthread_mutex_destroy(&p->lock);
+        free(p->threads);
+        free(p);
+}
@@ -0,0 +1,146 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "ampire-preload.h"
+#include "ampire-intern.h"
+
+// Holds a reference to each of the paths it has.
+struct Preloader {
+        pthread_mutex_t  lock;
+        pthread_cond_t   cond;
+        const char      *want;      // What should be loaded next
+        int              want_secs; // How long `want` is, or -1
+        const char      *loading;   // What the worker is loading right now
+        const char      *path;      // What `chunk` is
+        Mix_Chunk       *chunk;
+        uint64_t         rate;      // Bytes per second the mixer decodes to
+        int              stop;
+        pthread_t        thread;
+        int              started;
+};
+
+// Tell before decoding `path` if it stays below PRELOAD_MAX_BYTES.
+// Without its length the file size has to do, as if it was
+// compressed as much as any format we play would ever be.
+static int preload_fits(const Preloader *p, const char *path, int secs) {
+        uint64_t max_secs = PRELOAD_MAX_BYTES / p->rate;
+        if (secs >= 0) return (uint64_t)secs <= max_secs;
+
+        struct stat st;
+        if (stat(path, &st) == -1) return 0;
+        return (uint64_t)st.st_size * 8 / PRELOAD_MIN_BITRATE <= max_secs;
+}
+
+static void *preload_worker(void *arg) {
+        Preloader *p = (Preloader *)arg;
+
+        pthread_mutex_lock(&p->lock);
+        while (1) {
+                while (!p->stop && !p->want) {
+                        pthread_cond_wait(&p->cond, &p->lock);
+                }
+                if (p->stop) break;
+
+                const char *path = p->want;
+                int secs = p->want_secs;
+                p->want = NULL;
+                p->loading = path;
+                pthread_mutex_unlock(&p->lock);
+
+                Mix_Chunk *chunk = preload_fits(p, path, secs) ? Mix_LoadWAV(path) : NULL;
+                // The length from the tags may be off.
+                if (chunk && chunk->alen > PRELOAD_MAX_BYTES) {
+                        Mix_FreeChunk(chunk);
+                        chunk = NULL;
+                }
+
+                pthread_mutex_lock(&p->lock);
+                p->loading = NULL;
+                if (p->want || p->stop) {
+                        // Asked for something else in the meantime.
+                        if (chunk) Mix_FreeChunk(chunk);
+                        intern_unref(path);
+                } else {
+                        p->path = path;
+                        p->chunk = chunk;
+                }
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        return NULL;
+}
+
+Preloader *preload_create(void) {
+        Preloader *p = calloc(1, sizeof(Preloader));
+        pthread_mutex_init(&p->lock, NULL);
+        pthread_cond_init(&p->cond, NULL);
+
+        int freq, channels;
+        SDL_AudioFormat format;
+        if (Mix_QuerySpec(&freq, &format, &channels) && freq > 0) {
+                p->rate = (uint64_t)freq * SDL_AUDIO_BYTESIZE(format) * (uint64_t)channels;
+        }
+        if (p->rate == 0) p->rate = 44100 * 4;
+
+        p->started = pthread_create(&p->thread, NULL, preload_worker, p) == 0;
+        return p;
+}
+
+void preload_request(Preloader *p, const char *path, int secs) {
+        if (!p || !p->started || !path) return;
+
+        pthread_mutex_lock(&p->lock);
+        if (p->want == path || (!p->want && (p->loading == path || p->path == path))) {
+                pthread_mutex_unlock(&p->lock);
+                return;
+        }
+        if (p->chunk) {
+                Mix_FreeChunk(p->chunk);
+                p->chunk = NULL;
+        }
+        intern_unref(p->path);
+        intern_unref(p->want);
+        p->path = NULL;
+        p->want = intern_ref((char *)path);
+        p->want_secs = secs;
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+}
+
+Mix_Chunk *preload_take(Preloader *p, const char *path) {
+        if (!p || !p->started) return NULL;
+
+        Mix_Chunk *chunk = NULL;
+        pthread_mutex_lock(&p->lock);
+        // One that could not be decoded stays, so that asking
+        // for it again does not decode it again.
+        if (p->path == path && p->chunk) {
+                chunk = p->chunk;
+                p->chunk = NULL;
+                intern_unref(p->path);
+                p->path = NULL;
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        return chunk;
+}
+
+void preload_free(Preloader *p) {
+        if (!p) return;
+
+        pthread_mutex_lock(&p->lock);
+        p->stop = 1;
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+
+        if (p->started) pthread_join(p->thread, NULL);
+        if (p->chunk) Mix_FreeChunk(p->chunk);
+        intern_unref(p->want);
+        intern_unref(p->path);
+
+        pthread_mutex_destroy(&p->lock);
+        pthread_cond_destroy(&p->cond);
+        free(p);
+}
@@ -0,0 +1,730 @@
+#include <assert.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ampire-scan.h"
+#include "ampire-index.h"
+#include "ampire-filter.h"
+#include "ampire-intern.h"
+#include "ampire-flag.h"
+#include "ampire-global.h"
+#include "dyn_array.h"
+#include "ds/array.h"
+#include "ds/strmap.h"
+
+// Directory listings are I/O bound (especially on network mounts),
+// so we run more workers than there are cores.
+#define SCAN_THREADS_PER_CPU 2
+#define SCAN_MAX_THREADS     32
+
+// Directories that are found get opened right away with openat()
+// relative to their parent, which is much cheaper than resolving the
+// full path again later. To not run out of file descriptors on wide
+// trees, only this many queued directories may hold an open fd.
+#define SCAN_MAX_OPEN_FDS 256
+
+// Bytes read from the start of every new file to tell its format.
+#define SCAN_SNIFF_SZ 32
+
+typedef struct Scan_Node Scan_Node;
+
+typedef struct {
+        char          *name; // Name of the entry inside of the directory
+        unsigned char  type; // DT_REG or DT_DIR
+        dev_t          dev;  // Only set for files
+        ino_t          ino;
+        int            skip; // Excluded by a filter, only kept for the index
+        Scan_Node     *dir;  // Set if the subdirectory is being scanned
+} Scan_Entry;
+
+DYN_ARRAY_TYPE(Scan_Entry, Scan_Entry_Array);
+DYN_ARRAY_TYPE(Scan_Node *, Scan_Node_Array);
+
+struct Scan_Node {
+        char             *path;     // Absolute path of the directory
+        size_t            root;     // Index of the root it is below
+        int               fd;       // Opened by the parent, or -1
+        struct timespec   mtime;
+        struct timespec   read_at;  // When `mtime` was read
+        dev_t             dev;
+        ino_t             ino;
+        int               mtime_ok; // `mtime`, `dev` and `ino` could be read
+        int               cached;   // Entries were taken from the index
+        atomic_int        lost;     // The same directory comes earlier in the root
+        atomic_int        done;     // `entries` will not change anymore
+        Scan_Entry_Array  entries;  // Sorted by name after the scan
+};
+
+// Every worker owns one of these. The owner pushes and pops
+// at the back, idle workers steal from the front.
+typedef struct {
+        pthread_mutex_t  lock;
+        Scan_Node_Array  nodes;
+        size_t           head;
+} Scan_Deque;
+
+// Where scan_drain() left off in the tree of a root.
+typedef struct {
+        Scan_Node *node;
+        size_t     i;    // Next entry of `node` to look at
+} Scan_Frame;
+
+DYN_ARRAY_TYPE(Scan_Frame, Scan_Cursor);
+
+typedef struct {
+        Scan   *s;
+        size_t  id;
+} Scan_Worker;
+
+struct Scan {
+        Scan_Deque      *deques;
+        Scan_Worker     *workers;
+        size_t           nworkers;
+        atomic_size_t    pending;  // Nodes that are queued or being scanned
+        pthread_mutex_t  idle_lock;
+        pthread_cond_t   idle_cond; // Work was pushed or `pending` got to 0
+        atomic_size_t    work_gen;  // Bumped on every push
+        atomic_size_t    nidle;     // Workers waiting on `idle_cond`
+        atomic_int       open_fds; // Number of queued nodes holding an fd
+        atomic_size_t    ndirs;    // Directories read so far
+        atomic_size_t    nfiles;   // Songs found so far
+        atomic_size_t    nbad;     // Files that looked like songs but are not
+        atomic_int       cancel;
+        atomic_int       finished;
+        int              recursive;
+        char            *indexfp;
+        Index            idx;
+        Index           *idxp;     // Only read from while scanning
+        int              dedupe;   // Hand out every file only once per root
+        pthread_mutex_t  claims_lock;
+        Str_Map          claims;   // "root:dev:ino" -> Scan_Node ** that reads the directory
+        Scan_Node_Array  roots;
+        Scan_Cursor     *cursors;  // One for every root
+        Str_Map         *files;    // "dev:ino" of the files handed out for every root
+        pthread_t        thread;
+        int              joined;
+};
+
+int is_music_f(const char *fp) {
+        const char *ext = strrchr(fp, '.');
+        if (!ext) return 0;
+        ++ext;
+        return !strcmp(ext, "wav") || !strcmp(ext, "ogg") || !strcmp(ext, "mp3") || !strcmp(ext, "opus");
+}
+
+// An MPEG audio frame header: 11 sync bits, then a version,
+// layer, bitrate and sample rate that are not reserved.
+static int is_mpeg_frame(const uint8_t *h) {
+        return h[0] == 0xff && (h[1] & 0xe0) == 0xe0
+                && ((h[1] >> 3) & 3) != 1
+                && ((h[1] >> 1) & 3) != 0
+                && (h[2] >> 4) != 0xf
+                && ((h[2] >> 2) & 3) != 3;
+}
+
+int is_music_content(int dirfd, const char *name) {
+        int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return 0;
+
+        uint8_t h[SCAN_SNIFF_SZ];
+        ssize_t n = pread(fd, h, sizeof(h), 0);
+        close(fd);
+
+        if (n >= 12 && !memcmp(h, "RIFF", 4) && !memcmp(h+8, "WAVE", 4)) return 1;
+        // Vorbis and Opus are both in Ogg, the page header is enough.
+        if (n >= 27 && !memcmp(h, "OggS", 4) && h[4] == 0) return 1;
+        if (n >= 10 && !memcmp(h, "ID3", 3)) return 1;
+        if (n >= 4 && is_mpeg_frame(h)) return 1;
+
+        return 0;
+}
+
+static char *path_join(const char *dir, const char *name) {
+        size_t dn = strlen(dir), nn = strlen(name);
+        // Do not produce `//name` when scanning `/`.
+        if (dn > 0 && dir[dn-1] == '/') --dn;
+        char *p = malloc(dn + 1 + nn + 1);
+        memcpy(p, dir, dn);
+        p[dn] = '/';
+        memcpy(p+dn+1, name, nn+1);
+        return p;
+}
+
+static Scan_Node *node_create(char *path, size_t root, int fd) {
+        Scan_Node *n = malloc(sizeof(Scan_Node));
+        n->path = path;
+        n->root = root;
+        n->fd = fd;
+        n->mtime = (struct timespec) {0};
+        n->read_at = (struct timespec) {0};
+        n->dev = 0;
+        n->ino = 0;
+        n->mtime_ok = 0;
+        n->cached = 0;
+        atomic_init(&n->lost, 0);
+        atomic_init(&n->done, 0);
+        n->entries = dyn_array_empty(Scan_Entry_Array);
+        return n;
+}
+
+static void node_free(Scan_Node *n) {
+        for (size_t i = 0; i < n->entries.len; ++i) {
+                if (n->entries.data[i].dir) {
+                        node_free(n->entries.data[i].dir);
+                }
+                free(n->entries.data[i].name);
+        }
+        dyn_array_free(n->entries);
+        free(n->path);
+        free(n);
+}
+
+static void deque_push(Scan_Deque *dq, Scan_Node *n) {
+        pthread_mutex_lock(&dq->lock);
+        dyn_array_append(dq->nodes, n);
+        pthread_mutex_unlock(&dq->lock);
+}
+
+static Scan_Node *deque_pop(Scan_Deque *dq) {
+        Scan_Node *n = NULL;
+        pthread_mutex_lock(&dq->lock);
+        if (dq->nodes.len > dq->head) {
+                n = dq->nodes.data[--dq->nodes.len];
+                if (dq->nodes.len == dq->head) {
+                        dq->nodes.len = dq->head = 0;
+                }
+        }
+        pthread_mutex_unlock(&dq->lock);
+        return n;
+}
+
+static Scan_Node *deque_steal(Scan_Deque *dq) {
+        Scan_Node *n = NULL;
+        pthread_mutex_lock(&dq->lock);
+        if (dq->nodes.len > dq->head) {
+                n = dq->nodes.data[dq->head++];
+                if (dq->nodes.len == dq->head) {
+                        dq->nodes.len = dq->head = 0;
+                }
+        }
+        pthread_mutex_unlock(&dq->lock);
+        return n;
+}
+
+// Wake up the workers that found nothing to steal. `pushed` tells
+// if there is new work, otherwise `pending` just got to 0.
+static void wake_idle(Scan *s, int pushed) {
+        if (pushed) atomic_fetch_add(&s->work_gen, 1);
+        if (!pushed || atomic_load(&s->nidle) > 0) {
+                pthread_mutex_lock(&s->idle_lock);
+                pthread_cond_broadcast(&s->idle_cond);
+                pthread_mutex_unlock(&s->idle_lock);
+        }
+}
+
+// Sleep until there might be something to steal. A push after
+// `gen` was read is either seen here or wakes us up, as it bumps
+// `work_gen` before it looks at `nidle`.
+static void wait_idle(Scan *s, size_t gen) {
+        pthread_mutex_lock(&s->idle_lock);
+        atomic_fetch_add(&s->nidle, 1);
+        while (atomic_load(&s->pending) > 0 && atomic_load(&s->work_gen) == gen) {
+                pthread_cond_wait(&s->idle_cond, &s->idle_lock);
+        }
+        atomic_fetch_sub(&s->nidle, 1);
+        pthread_mutex_unlock(&s->idle_lock);
+}
+
+static void scan_noop_free(uint8_t *v) {
+        (void)v;
+}
+
+static int entry_cmp(const void *a, const void *b) {
+        return strcmp(((const Scan_Entry *)a)->name, ((const Scan_Entry *)b)->name);
+}
+
+static int timespec_eq(struct timespec a, struct timespec b) {
+        return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+// Compare two paths below the same root by the order
+// that scan_drain() hands them out in.
+static int path_order(const char *a, const char *b) {
+        for (; *a && *a == *b; ++a, ++b);
+        if (*a == *b) return 0;
+        // Parents come before their children, and
+        // a name that ends first sorts first.
+        if (*a == '\0') return -1;
+        if (*b == '\0') return 1;
+        if (*a == '/') return -1;
+        if (*b == '/') return 1;
+        return (unsigned char)*a < (unsigned char)*b ? -1 : 1;
+}
+
+// Symlinks and bind mounts can lead to the same directory more than
+// once, or back into one of its parents. Only the path that comes first
+// in the root gets to read it, so the result does not depend on which
+// worker got there first. Returns 0 if `n` should not be read.
+static int node_claim(Scan *s, Scan_Node *n) {
+        char key[64];
+        snprintf(key, sizeof(key), "%zu:%llu:%llu", n->root,
+                 (unsigned long long)n->dev, (unsigned long long)n->ino);
+
+        int won = 1;
+        pthread_mutex_lock(&s->claims_lock);
+        Scan_Node **owner = (Scan_Node **)strmap_get(&s->claims, key);
+        if (!owner) {
+                owner = malloc(sizeof(Scan_Node *));
+                *owner = n;
+                strmap_insert(&s->claims, key, (uint8_t *)owner);
+        } else if (path_order(n->path, (*owner)->path) < 0) {
+                // A parent always claims before its children exist,
+                // so this never happens for a loop.
+                atomic_store(&(*owner)->lost, 1);
+                *owner = n;
+        } else {
+                won = 0;
+        }
+        pthread_mutex_unlock(&s->claims_lock);
+
+        return won;
+}
+
+static void node_add(Scan *s, size_t id, Scan_Node *n, int fd, const char *name,
+                     unsigned char type, dev_t dev, ino_t ino) {
+        Scan_Node *child = NULL;
+        // Filtered out entries still go into the index, so
+        // that it does not depend on the filters in use.
+        int skip = type == DT_DIR ? !filter_dir(name) : !filter_file(name);
+
+        if (type == DT_DIR && s->recursive && !skip) {
+                int cfd = -1;
+                if (atomic_fetch_add(&s->open_fds, 1) < SCAN_MAX_OPEN_FDS) {
+                        cfd = openat(fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                }
+                if (cfd == -1) {
+                        atomic_fetch_sub(&s->open_fds, 1);
+                }
+                child = node_create(path_join(n->path, name), n->root, cfd);
+        } else if (type == DT_REG && !skip) {
+                atomic_fetch_add(&s->nfiles, 1);
+        }
+
+        dyn_array_append(n->entries, ((Scan_Entry) {
+                .name = strdup(name),
+                .type = type,
+                .dev = type == DT_REG ? dev : 0,
+                .ino = type == DT_REG ? ino : 0,
+                .skip = skip,
+                .dir = child,
+        }));
+
+        if (child) {
+                atomic_fetch_add(&s->pending, 1);
+                deque_push(&s->deques[id], child);
+                wake_idle(s, 1);
+        }
+}
+
+static void scan_node(Scan *s, size_t id, Scan_Node *n) {
+        int fd = n->fd;
+        if (fd == -1) {
+                fd = open(n->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if (fd == -1) return;
+        } else {
+                n->fd = -1;
+                atomic_fetch_sub(&s->open_fds, 1);
+        }
+
+        struct stat st;
+        (void)clock_gettime(CLOCK_REALTIME, &n->read_at);
+        if (fstat(fd, &st) == 0) {
+                n->mtime = st.st_mtim;
+                n->dev = st.st_dev;
+                n->ino = st.st_ino;
+                n->mtime_ok = 1;
+
+                if (s->recursive && !node_claim(s, n)) {
+                        atomic_store(&n->lost, 1);
+                        close(fd);
+                        return;
+                }
+        }
+
+        // Nothing was added, removed or renamed since the
+        // last scan, so the listing in the index is still good.
+        Index_Dir *d = s->idxp && n->mtime_ok ? index_get(s->idxp, n->path) : NULL;
+        if (d && timespec_eq(d->mtime, n->mtime)) {
+                for (size_t i = 0; i < d->entries.len; ++i) {
+                        const Index_Entry *e = &d->entries.data[i];
+                        node_add(s, id, n, fd, e->name, e->type, e->dev, e->ino);
+                }
+                n->cached = 1;
+                close(fd);
+                return;
+        }
+
+        DIR *dir = fdopendir(fd);
+        if (!dir) {
+                close(fd);
+                return;
+        }
+
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+                const char *name = entry->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                        continue;
+                }
+
+                // Only stat() when the filesystem does not tell us the
+                // type, or when we need to see through a symlink.
+                unsigned char type = entry->d_type;
+                dev_t dev = n->dev;
+                ino_t ino = entry->d_ino;
+                if (type == DT_UNKNOWN || type == DT_LNK) {
+                        if (fstatat(fd, name, &st, 0) == -1) continue;
+                        type = S_ISREG(st.st_mode) ? DT_REG : S_ISDIR(st.st_mode) ? DT_DIR : DT_UNKNOWN;
+                        dev = st.st_dev;
+                        ino = st.st_ino;
+                }
+
+                if (type == DT_REG && is_music_f(name)) {
+                        // Only directories that changed get here, so every
+                        // file is looked at once and then kept in the index.
+                        if (!is_music_content(dirfd(dir), name)) {
+                                atomic_fetch_add(&s->nbad, 1);
+                                continue;
+                        }
+                        node_add(s, id, n, dirfd(dir), name, type, dev, ino);
+                } else if (type == DT_DIR) {
+                        node_add(s, id, n, dirfd(dir), name, type, dev, ino);
+                }
+        }
+
+        closedir(dir);
+
+        if (n->entries.len > 1) {
+                qsort(n->entries.data, n->entries.len, sizeof(Scan_Entry), entry_cmp);
+        }
+}
+
+static void *scan_worker(void *arg) {
+        Scan_Worker *w = (Scan_Worker *)arg;
+        Scan *s = w->s;
+
+        while (atomic_load(&s->pending) > 0) {
+                size_t gen = atomic_load(&s->work_gen);
+                Scan_Node *n = deque_pop(&s->deques[w->id]);
+                for (size_t i = 1; !n && i < s->nworkers; ++i) {
+                        n = deque_steal(&s->deques[(w->id + i) % s->nworkers]);
+                }
+                if (!n) {
+                        // Someone else is still reading a directory,
+                        // which may or may not have more under it.
+                        wait_idle(s, gen);
+                        continue;
+                }
+                if (atomic_load(&s->cancel)) {
+                        // Only empty out the queues.
+                        if (n->fd != -1) {
+                                close(n->fd);
+                                n->fd = -1;
+                                atomic_fetch_sub(&s->open_fds, 1);
+                        }
+                } else {
+                        scan_node(s, w->id, n);
+                        atomic_fetch_add(&s->ndirs, 1);
+                }
+
+                atomic_store_explicit(&n->done, 1, memory_order_release);
+                if (atomic_fetch_sub(&s->pending, 1) == 1) {
+                        wake_idle(s, 0);
+                }
+        }
+
+        return NULL;
+}
+
+// Store what was read from disk back into the index.
+static void index_update(Index *idx, const Scan_Node *n) {
+        if (n->cached) {
+                index_seen(idx, n->path);
+        } else if (n->mtime_ok && !atomic_load(&n->lost)) {
+                Index_Dir *d = index_put(idx, n->path, n->mtime);
+                for (size_t i = 0; i < n->entries.len; ++i) {
+                        const Scan_Entry *e = &n->entries.data[i];
+                        index_dir_add(idx, d, e->name, e->type, e->dev, e->ino);
+                }
+        }
+
+        for (size_t i = 0; i < n->entries.len; ++i) {
+                if (n->entries.data[i].dir) {
+                        index_update(idx, n->entries.data[i].dir);
+                }
+        }
+}
+
+static size_t scan_nthreads(void) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        if (ncpu < 1) ncpu = 1;
+        size_t n = (size_t)ncpu * SCAN_THREADS_PER_CPU;
+        return n > SCAN_MAX_THREADS ? SCAN_MAX_THREADS : n;
+}
+
+static void *scan_main(void *arg) {
+        Scan *s = (Scan *)arg;
+
+        // Loading the index takes a moment on big libraries as
+        // well, so it happens here and not in scan_start().
+        if (s->indexfp) {
+                s->idx = index_load(s->indexfp);
+                s->idxp = &s->idx;
+        }
+
+        pthread_t *threads = malloc(sizeof(pthread_t) * s->nworkers);
+        size_t nthreads = 0;
+        for (size_t i = 1; i < s->nworkers; ++i) {
+                if (pthread_create(&threads[nthreads], NULL, scan_worker, &s->workers[i]) == 0) {
+                        ++nthreads;
+                }
+        }
+        (void)scan_worker(&s->workers[0]);
+        for (size_t i = 0; i < nthreads; ++i) {
+                pthread_join(threads[i], NULL);
+        }
+        free(threads);
+
+        if (s->idxp) {
+                // A cancelled scan did not see everything,
+                // so the index is left the way it was.
+                if (!atomic_load(&s->cancel)) {
+                        for (size_t i = 0; i < s->roots.len; ++i) {
+                                index_update(s->idxp, s->roots.data[i]);
+                                // Directories below the root that were not visited are gone.
+                                if (s->recursive) {
+                                        index_prune(s->idxp, s->roots.data[i]->path);
+                                }
+                        }
+                        index_save(s->idxp);
+                }
+                index_free(s->idxp);
+                s->idxp = NULL;
+        }
+
+        atomic_store(&s->finished, 1);
+        return NULL;
+}
+
+Scan *scan_start(const Str_Array *roots, const char *indexfp) {
+        Scan *s = malloc(sizeof(Scan));
+
+        s->recursive = (g_config.flags & FT_RECURSIVE) != 0;
+        // Without recursion there is only a single directory per root to read.
+        s->nworkers = s->recursive ? scan_nthreads() : 1;
+        atomic_init(&s->pending, roots->len);
+        pthread_mutex_init(&s->idle_lock, NULL);
+        pthread_cond_init(&s->idle_cond, NULL);
+        atomic_init(&s->work_gen, 0);
+        atomic_init(&s->nidle, 0);
+        atomic_init(&s->open_fds, 0);
+        atomic_init(&s->ndirs, 0);
+        atomic_init(&s->nfiles, 0);
+        atomic_init(&s->nbad, 0);
+        atomic_init(&s->cancel, 0);
+        atomic_init(&s->finished, 0);
+        s->indexfp = indexfp ? strdup(indexfp) : NULL;
+        s->idxp = NULL;
+        s->roots = dyn_array_empty(Scan_Node_Array);
+        s->dedupe = (g_config.flags & FT_DEDUPE) != 0;
+        pthread_mutex_init(&s->claims_lock, NULL);
+        s->claims = strmap_create(NULL, NULL);
+        s->cursors = malloc(sizeof(Scan_Cursor) * (roots->len ? roots->len : 1));
+        s->files = s->dedupe ? malloc(sizeof(Str_Map) * (roots->len ? roots->len : 1)) : NULL;
+        s->joined = 0;
+
+        s->deques = malloc(sizeof(Scan_Deque) * s->nworkers);
+        s->workers = malloc(sizeof(Scan_Worker) * s->nworkers);
+        for (size_t i = 0; i < s->nworkers; ++i) {
+                pthread_mutex_init(&s->deques[i].lock, NULL);
+                s->deques[i].nodes = dyn_array_empty(Scan_Node_Array);
+                s->deques[i].head = 0;
+                s->workers[i] = (Scan_Worker) { .s = s, .id = i };
+        }
+
+        for (size_t i = 0; i < roots->len; ++i) {
+                Scan_Node *n = node_create(strdup(roots->data[i]), i, -1);
+                dyn_array_append(s->roots, n);
+                s->cursors[i] = dyn_array_empty(Scan_Cursor);
+                if (s->files) {
+                        s->files[i] = strmap_create(NULL, scan_noop_free);
+                }
+                dyn_array_append(s->cursors[i], ((Scan_Frame) { .node = n, .i = 0 }));
+                deque_push(&s->deques[i % s->nworkers], n);
+        }
+
+        if (pthread_create(&s->thread, NULL, scan_main, s) != 0) {
+                // Could not get a thread, so scan right here.
+                (void)scan_main(s);
+                s->joined = 1;
+        }
+
+        return s;
+}
+
+int scan_drain(Scan *s, size_t root, int interned, Str_Array *out, Scan_Dir_Array *dirs) {
+        assert(root < s->roots.len);
+        Scan_Cursor *c = &s->cursors[root];
+
+        // Walk the tree in its final order for as long as the
+        // directories on the way have been read completely.
+        while (c->len > 0) {
+                Scan_Frame *f = &c->data[c->len-1];
+                if (!atomic_load_explicit(&f->node->done, memory_order_acquire)) {
+                        return 0;
+                }
+
+                if (f->i == 0 && atomic_load(&f->node->lost)) {
+                        --c->len;
+                        continue;
+                }
+
+                if (f->i == 0 && dirs) {
+                        dyn_array_append(*dirs, ((Scan_Dir) {
+                                .path = strdup(f->node->path),
+                                .node = f->node,
+                        }));
+                }
+
+                if (f->i >= f->node->entries.len) {
+                        --c->len;
+                        continue;
+                }
+
+                const Scan_Entry *e = &f->node->entries.data[f->i++];
+                if (e->dir) {
+                        dyn_array_append(*c, ((Scan_Frame) { .node = e->dir, .i = 0 }));
+                } else if (e->type == DT_REG && !e->skip) {
+                        if (s->files) {
+                                char key[48];
+                                snprintf(key, sizeof(key), "%llu:%llu",
+                                         (unsigned long long)e->dev, (unsigned long long)e->ino);
+                                if (strmap_contains(&s->files[root], key)) continue;
+                                strmap_insert(&s->files[root], key, (uint8_t *)1);
+                        }
+                        char *path = interned
+                                ? intern_path(f->node->path, e->name)
+                                : path_join(f->node->path, e->name);
+                        dyn_array_append(*out, path);
+                }
+        }
+
+        return 1;
+}
+
+void scan_recheck(Scan *s, const Scan_Dir *d, int interned, Str_Array *out, Str_Array *subdirs) {
+        const Scan_Node *n = (const Scan_Node *)d->node;
+        if (!n->mtime_ok) return;
+
+        struct stat st;
+        if (stat(n->path, &st) == -1) return;
+        // Timestamps are only as fine as the clock tick of the kernel, so
+        // a change right after the scan looked can keep the same mtime.
+        // Only a directory that was last changed well before can be trusted.
+        if (timespec_eq(st.st_mtim, n->mtime) && n->mtime.tv_sec + 1 < n->read_at.tv_sec) {
+                return;
+        }
+
+        DIR *dir = opendir(n->path);
+        if (!dir) return;
+
+        Str_Map known = strmap_create(NULL, scan_noop_free);
+        for (size_t i = 0; i < n->entries.len; ++i) {
+                strmap_insert(&known, n->entries.data[i].name, (uint8_t *)1);
+        }
+
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+                const char *name = entry->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                        continue;
+                }
+                if (strmap_contains(&known, name)) continue;
+
+                unsigned char type = entry->d_type;
+                if (type == DT_UNKNOWN || type == DT_LNK) {
+                        if (fstatat(dirfd(dir), name, &st, 0) == -1) continue;
+                        type = S_ISREG(st.st_mode) ? DT_REG : S_ISDIR(st.st_mode) ? DT_DIR : DT_UNKNOWN;
+                }
+
+                if (type == DT_REG && is_music_f(name) && filter_file(name)
+                    && is_music_content(dirfd(dir), name)) {
+                        dyn_array_append(*out, interned ? intern_path(n->path, name) : path_join(n->path, name));
+                } else if (type == DT_DIR && s->recursive && filter_dir(name)) {
+                        dyn_array_append(*subdirs, path_join(n->path, name));
+                }
+        }
+
+        closedir(dir);
+        strmap_free(&known);
+}
+
+int scan_finished(Scan *s) {
+        return atomic_load(&s->finished);
+}
+
+size_t scan_ndirs(Scan *s) {
+        return atomic_load(&s->ndirs);
+}
+
+size_t scan_nfiles(Scan *s) {
+        return atomic_load(&s->nfiles);
+}
+
+size_t scan_nbad(Scan *s) {
+        return atomic_load(&s->nbad);
+}
+
+void scan_wait(Scan *s) {
+        if (!s->joined) {
+                pthread_join(s->thread, NULL);
+                s->joined = 1;
+        }
+}
+
+void scan_free(Scan *s) {
+        atomic_store(&s->cancel, 1);
+        scan_wait(s);
+
+        for (size_t i = 0; i < s->roots.len; ++i) {
+                node_free(s->roots.data[i]);
+                dyn_array_free(s->cursors[i]);
+                if (s->files) {
+                        strmap_free(&s->files[i]);
+                }
+        }
+        for (size_t i = 0; i < s->nworkers; ++i) {
+                pthread_mutex_destroy(&s->deques[i].lock);
+                dyn_array_free(s->deques[i].nodes);
+        }
+        pthread_mutex_destroy(&s->claims_lock);
+        pthread_mutex_destroy(&s->idle_lock);
+        pthread_cond_destroy(&s->idle_cond);
+        strmap_free(&s->claims);
+        dyn_array_free(s->roots);
+        free(s->cursors);
+        free(s->files);
+        free(s->deques);
+        free(s->workers);
+        free(s->indexfp);
+        free(s);
+}
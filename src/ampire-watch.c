@@ -0,0 +1,238 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "ampire-watch.h"
+#include "ampire-scan.h"
+#include "ampire-filter.h"
+#include "ampire-flag.h"
+#include "ampire-global.h"
+#include "dyn_array.h"
+#include "ds/array.h"
+
+#define WATCH_MASK (IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO \
+                    | IN_ONLYDIR | IN_EXCL_UNLINK)
+
+// A file that was moved away, which stays here until we know if it was
+// moved somewhere else that we watch (a rename) or out of our sight.
+typedef struct {
+        uint32_t  cookie;
+        int       is_dir;
+        void     *owner;
+        char     *path;
+} Watch_Moved;
+
+static char *path_join(const char *dir, const char *name) {
+        size_t dn = strlen(dir), nn = strlen(name);
+        if (dn > 0 && dir[dn-1] == '/') --dn;
+        char *p = malloc(dn + 1 + nn + 1);
+        memcpy(p, dir, dn);
+        p[dn] = '/';
+        memcpy(p+dn+1, name, nn+1);
+        return p;
+}
+
+static int is_below(const char *path, const char *dir) {
+        size_t n = strlen(dir);
+        return !strncmp(path, dir, n) && (path[n] == '/' || path[n] == '\0');
+}
+
+static void emit(Watch_Event_Array *out, Watch_Event_Kind kind, void *owner, char *path, char *newpath) {
+        dyn_array_append(*out, ((Watch_Event) {
+                .kind = kind,
+                .owner = owner,
+                .path = path,
+                .newpath = newpath,
+        }));
+}
+
+int watch_init(Watcher *w) {
+        w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        w->dirs = dyn_array_empty(Watch_Dir_Array);
+        w->full = 0;
+        if (w->fd == -1) {
+                perror("inotify_init1");
+                return 0;
+        }
+        return 1;
+}
+
+int watch_add(Watcher *w, const char *dir, void *owner) {
+        if (w->fd == -1 || w->full) return 0;
+
+        int wd = inotify_add_watch(w->fd, dir, WATCH_MASK);
+        if (wd == -1) {
+                if (errno == ENOSPC) w->full = 1;
+                return 0;
+        }
+
+        while (w->dirs.len <= (size_t)wd) {
+                dyn_array_append(w->dirs, ((Watch_Dir) { .path = NULL, .owner = NULL }));
+        }
+        free(w->dirs.data[wd].path);
+        w->dirs.data[wd] = (Watch_Dir) {
+                .path = strdup(dir),
+                .owner = owner,
+        };
+        return 1;
+}
+
+static Watch_Dir *watch_lookup(Watcher *w, int wd) {
+        if (wd < 0 || (size_t)wd >= w->dirs.len || !w->dirs.data[wd].path) {
+                return NULL;
+        }
+        return &w->dirs.data[wd];
+}
+
+static void watch_forget(Watcher *w, int wd) {
+        Watch_Dir *d = watch_lookup(w, wd);
+        if (d) {
+                free(d->path);
+                d->path = NULL;
+        }
+}
+
+// Stop watching `dir` and everything below it.
+static void watch_rm_tree(Watcher *w, const char *dir) {
+        for (size_t i = 0; i < w->dirs.len; ++i) {
+                if (w->dirs.data[i].path && is_below(w->dirs.data[i].path, dir)) {
+                        (void)inotify_rm_watch(w->fd, (int)i);
+                        watch_forget(w, (int)i);
+                }
+        }
+}
+
+// The watch descriptors stay valid across a rename,
+// only the paths we remember need to change.
+static void watch_rename_tree(Watcher *w, const char *from, const char *to) {
+        size_t fn = strlen(from), tn = strlen(to);
+        for (size_t i = 0; i < w->dirs.len; ++i) {
+                char *path = w->dirs.data[i].path;
+                if (!path || !is_below(path, from)) continue;
+                size_t rest = strlen(path+fn);
+                char *p = malloc(tn + rest + 1);
+                memcpy(p, to, tn);
+                memcpy(p+tn, path+fn, rest+1);
+                free(path);
+                w->dirs.data[i].path = p;
+        }
+}
+
+static const char *base_name(const char *path) {
+        const char *slash = strrchr(path, '/');
+        return slash ? slash+1 : path;
+}
+
+static void flush_moved(Watcher *w, Watch_Moved *m, Watch_Event_Array *out) {
+        if (!m->path) return;
+
+        if (m->is_dir) {
+                watch_rm_tree(w, m->path);
+                emit(out, WATCH_REMOVE_DIR, m->owner, m->path, NULL);
+        } else if (is_music_f(m->path)) {
+                emit(out, WATCH_REMOVE, m->owner, m->path, NULL);
+        } else {
+                free(m->path);
+        }
+
+        m->path = NULL;
+}
+
+static void handle_rename(Watcher *w, Watch_Moved *m, char *to, Watch_Event_Array *out) {
+        if (m->is_dir) {
+                watch_rename_tree(w, m->path, to);
+                emit(out, WATCH_RENAME_DIR, m->owner, m->path, to);
+        } else if (is_music_f(m->path) && is_music_f(to) && filter_file(base_name(to))) {
+                emit(out, WATCH_RENAME, m->owner, m->path, to);
+        } else if (is_music_f(to) && filter_file(base_name(to)) && is_music_content(AT_FDCWD, to)) {
+                free(m->path);
+                emit(out, WATCH_ADD, m->owner, to, NULL);
+        } else {
+                flush_moved(w, m, out);
+                free(to);
+        }
+        m->path = NULL;
+}
+
+void watch_poll(Watcher *w, Watch_Event_Array *out) {
+        if (w->fd == -1) return;
+
+        // Only a single read() per call, so that a burst
+        // of events never holds up the caller for long.
+        char buf[1 << 16] __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t n = read(w->fd, buf, sizeof(buf));
+        if (n <= 0) return;
+
+        Watch_Moved moved = { .path = NULL };
+
+        for (char *p = buf; p < buf + n;) {
+                const struct inotify_event *ev = (const struct inotify_event *)p;
+                p += sizeof(struct inotify_event) + ev->len;
+
+                if (ev->mask & IN_IGNORED) {
+                        watch_forget(w, ev->wd);
+                        continue;
+                }
+
+                Watch_Dir *d = watch_lookup(w, ev->wd);
+                if (!d || ev->len == 0) continue;
+
+                void *owner = d->owner;
+                int is_dir = (ev->mask & IN_ISDIR) != 0;
+                char *path = path_join(d->path, ev->name);
+
+                if ((ev->mask & IN_MOVED_TO) && moved.path
+                    && moved.cookie == ev->cookie && moved.owner == owner) {
+                        handle_rename(w, &moved, path, out);
+                        continue;
+                }
+
+                flush_moved(w, &moved, out);
+
+                if (ev->mask & IN_MOVED_FROM) {
+                        moved = (Watch_Moved) {
+                                .cookie = ev->cookie,
+                                .is_dir = is_dir,
+                                .owner = owner,
+                                .path = path,
+                        };
+                } else if (is_dir && (ev->mask & (IN_CREATE | IN_MOVED_TO))) {
+                        // Watched before anything in it is read, the
+                        // caller scans what is in there already.
+                        if ((g_config.flags & FT_RECURSIVE) && filter_dir(ev->name)) {
+                                (void)watch_add(w, path, owner);
+                                emit(out, WATCH_ADD_DIR, owner, path, NULL);
+                        } else {
+                                free(path);
+                        }
+                } else if (is_dir && (ev->mask & IN_DELETE)) {
+                        emit(out, WATCH_REMOVE_DIR, owner, path, NULL);
+                } else if (!is_dir && is_music_f(ev->name) && (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                           && filter_file(ev->name) && is_music_content(AT_FDCWD, path)) {
+                        emit(out, WATCH_ADD, owner, path, NULL);
+                } else if (!is_dir && is_music_f(ev->name) && (ev->mask & IN_DELETE)) {
+                        emit(out, WATCH_REMOVE, owner, path, NULL);
+                } else {
+                        free(path);
+                }
+        }
+
+        // The other half of a rename usually comes in the same read(),
+        // if it did not, the file was moved somewhere we do not watch.
+        flush_moved(w, &moved, out);
+}
+
+void watch_free(Watcher *w) {
+        for (size_t i = 0; i < w->dirs.len; ++i) {
+                free(w->dirs.data[i].path);
+        }
+        dyn_array_free(w->dirs);
+        if (w->fd != -1) close(w->fd);
+        w->fd = -1;
+}
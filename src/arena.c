@@ -0,0 +1,60 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ds/arena.h"
+
+Arena *arena_create(void) {
+        Arena *a = malloc(sizeof(Arena));
+        a->head = NULL;
+        return a;
+}
+
+void *arena_alloc(Arena *a, size_t n) {
+        assert(a);
+        __Arena_Chunk *c = a->head;
+        if (!c || c->cap - c->len < n) {
+                // Big strings get a chunk of their own, the
+                // current chunk stays in front for the rest.
+                size_t cap = n > ARENA_CHUNK_SZ ? n : ARENA_CHUNK_SZ;
+                __Arena_Chunk *nc = malloc(sizeof(__Arena_Chunk) + cap);
+                nc->len = 0;
+                nc->cap = cap;
+                if (c && n > ARENA_CHUNK_SZ) {
+                        nc->next = c->next;
+                        c->next = nc;
+                } else {
+                        nc->next = c;
+                        a->head = nc;
+                }
+                c = nc;
+        }
+        void *p = c->data + c->len;
+        c->len += n;
+        return p;
+}
+
+char *arena_strdup(Arena *a, const char *s) {
+        size_t n = strlen(s) + 1;
+        char *p = arena_alloc(a, n);
+        memcpy(p, s, n);
+        return p;
+}
+
+char *arena_strndup(Arena *a, const char *s, size_t n) {
+        char *p = arena_alloc(a, n + 1);
+        memcpy(p, s, n);
+        p[n] = '\0';
+        return p;
+}
+
+void arena_free(Arena *a) {
+        if (!a) return;
+        __Arena_Chunk *c = a->head;
+        while (c) {
+                __Arena_Chunk *next = c->next;
+                free(c);
+                c = next;
+        }
+        free(a);
+}
@@ -8,6 +8,6 @@ import "std/datatypes/list.rl";
 @const let flags   = "-O0 -ggdb -o ampire-debug-build";
 @const let files   = List::to_str(sys::get_all_files_by_ext(".", "c"));
 @const let include = "-Iinclude -I../external/SDL3/include -I../external/SDL3_mixer/include";
-@const let link    = "-lncurses -ltinfo -lSDL3_mixer -lSDL3";
+@const let link    = "-lncurses -ltinfo -lSDL3_mixer -lSDL3 -lpthread";
 
 $f"cc {files} {link} {include} {flags}";
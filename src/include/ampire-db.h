@@ -0,0 +1,140 @@
+#ifndef DB_H
+#define DB_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dyn_array.h"
+#include "ds/array.h"
+
+// Playlists in a binary file that is mmap()'d, so that opening
+// it does not depend on how many songs are in it.
+//
+//   Db_Header
+//   Db_Playlist  playlists[nplaylists]
+//   uint32_t     songs[]  // Offsets into the string table, per playlist
+//   char         strtab[] // NUL terminated, every distinct path only once
+//
+// Everything is in host byte order, `magic` tells if it is not.
+// Older versions kept every playlist in one of these, with the
+// changes since in a journal, see below.
+
+#define DB_MAGIC   "AMPIREDB"
+#define DB_VERSION 2
+
+#define DB_WRITE_CHUNK (1024 * 1024) // Most db_write() writes at once
+
+typedef struct {
+        char     magic[8];
+        uint32_t version;
+        uint32_t nplaylists;
+        uint64_t size;       // Of the whole file, to notice truncation
+        uint64_t strtab;     // File offset of the string table
+        uint64_t strtab_len;
+        uint64_t seq;        // Last journal record that is included, not in version 1
+} Db_Header;
+
+typedef struct {
+        uint32_t name;   // Offset into the string table
+        uint32_t nsongs;
+        uint64_t songs;  // File offset of the song offsets
+} Db_Playlist;
+
+typedef struct {
+        const uint8_t     *map;
+        size_t             len;
+        const Db_Header   *hdr;
+        const Db_Playlist *playlists;
+        uint64_t           seq;
+} Db;
+
+// What to write for one playlist.
+typedef struct {
+        const char      *name;
+        const Str_Array *songfps;
+} Db_Entry;
+
+DYN_ARRAY_TYPE(Db_Entry, Db_Entry_Array);
+
+// Returns 0 if the file does not exist or is not a valid database.
+int db_open(const char *fp, Db *db);
+void db_close(Db *db);
+
+size_t db_len(const Db *db);
+const char *db_name(const Db *db, size_t i);
+size_t db_nsongs(const Db *db, size_t i);
+// Song `j` of playlist `i`, in the mapping, or NULL if it is damaged.
+const char *db_song(const Db *db, size_t i, size_t j);
+// Append the songs of playlist `i` to `out`. The strings point
+// into the mapping and stay valid until db_close().
+void db_songs(const Db *db, size_t i, Str_Array *out);
+
+// Replace the file at `fp` with the playlists in `entries`, which
+// include every journal record up to `seq`. The new file is written
+// next to it first, so a crash leaves either the old or the new one.
+// Adds the bytes written to `done` as it goes, if it is not NULL.
+// Returns 0 on failure.
+int db_write(const char *fp, const Db_Entry *entries, size_t n, uint64_t seq, atomic_size_t *done);
+
+// At most how big db_write() makes the file.
+size_t db_size_max(const Db_Entry *entries, size_t n);
+
+// The journal of older versions is a file of records that were
+// only ever appended to, one for every change to a playlist:
+//
+//   char magic[8]
+//   Db_Record_Header + payload, padded to 8 bytes
+//
+// The payload is a list of NUL terminated strings: the name of the
+// playlist, then the new name or the songs. A record that was only
+// partly written when we crashed fails its checksum and is dropped.
+// Records are numbered, so that the ones that made it into the
+// database can be told apart from the ones that did not.
+
+#define DB_JOURNAL_MAGIC "AMPJRNL1"
+
+typedef enum {
+        DB_OP_CREATE,  // Add a new playlist
+        DB_OP_REPLACE, // Replace the songs of a playlist, or add it
+        DB_OP_DELETE,  // Remove every playlist with that name
+        DB_OP_RENAME,
+} Db_Op;
+
+typedef struct {
+        uint64_t seq;
+        uint32_t op;
+        uint32_t len; // Of the payload
+        uint32_t crc; // Of the other fields and the payload
+        uint32_t pad;
+} Db_Record_Header;
+
+typedef struct {
+        uint64_t    seq;
+        Db_Op       op;
+        const char *name;
+        const char *newname; // DB_OP_RENAME
+        Str_Array   songfps; // DB_OP_CREATE and DB_OP_REPLACE
+        const char *songs;   // The same when read from a journal, see db_record_songs()
+        const char *songs_end;
+} Db_Record;
+
+typedef struct {
+        const uint8_t *map;
+        size_t         maplen;
+        size_t         len;     // Of the valid part of `map`
+        size_t         pos;     // Next record to hand out
+} Db_Journal;
+
+// Returns 0 if there is no journal at `fp`.
+int db_journal_open(const char *fp, Db_Journal *j);
+void db_journal_close(Db_Journal *j);
+
+// Hand out the records of the journal. The strings point into it
+// and stay valid until it is closed. Returns 0 at the end.
+int db_journal_next(Db_Journal *j, Db_Record *r);
+
+// Append the songs of a record to `out`.
+void db_record_songs(const Db_Record *r, Str_Array *out);
+
+#endif // DB_H
@@ -2,11 +2,18 @@
 #define DISPLAY_H
 
 #include "ds/array.h"
+#include "ds/arena.h"
+#include "ampire-scan.h"
 
 typedef struct {
         Str_Array songfps;
+        Arena *arena;     // Owns the name and the tags, the songs are interned
         char *name;
         int from_cli;
+        int loaded;       // Saved playlists only get `songfps` once they are opened
+        size_t saved_id;  // What to pass to io_load_playlist()
+        Scan *scan;       // Still being filled in by a background scan, or NULL
+        size_t scan_root; // Which root of `scan` this playlist is
 } Playlist;
 
 DYN_ARRAY_TYPE(Playlist, Playlist_Array);
@@ -0,0 +1,17 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+// Glob patterns from --include and --exclude. They are matched
+// against the name of an entry inside of its directory, not
+// against the full path.
+
+void filter_include(const char *glob);
+void filter_exclude(const char *glob);
+
+// Whether the directory `name` should be scanned.
+int filter_dir(const char *name);
+
+// Whether the file `name` should be added to a playlist.
+int filter_file(const char *name);
+
+#endif // FILTER_H
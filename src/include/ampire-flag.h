@@ -10,6 +10,8 @@ enum {
         FT_SHOW_SAVES = 1 << 3,
         FT_DISABLE_PLAYER_LOGO = 1 << 4,
         FT_ONESHOT = 1 << 5,
+        FT_WATCH = 1 << 6,
+        FT_DEDUPE = 1 << 7,
 };
 
 #endif // FLAG_H
@@ -0,0 +1,43 @@
+#ifndef GAPLESS_H
+#define GAPLESS_H
+
+#include <SDL3_mixer/SDL_mixer.h>
+
+// Plays songs that were decoded up front with Mix_LoadWAV() through
+// Mix_HookMusic(). The song queued after the current one is started
+// in the same audio callback the current one ends in, so there is
+// not a single sample of silence between them. Chunks belong to the
+// player once they are handed to it, and it keeps a reference to
+// their interned paths. Only call these from the main thread.
+
+typedef enum {
+        GAPLESS_NONE,
+        GAPLESS_NEXT, // Went on to the queued song
+        GAPLESS_END,  // Ran out with nothing queued
+} Gapless_Event;
+
+// After Mix_OpenAudio(). Returns 0 if the format of the mixer
+// is not known, the player can not be used then.
+int gapless_init(void);
+int gapless_available(void);
+
+// Play `c` from the start, instead of anything that was playing or queued.
+void gapless_play(Mix_Chunk *c, const char *path);
+// The song to play right after the current one, NULL for none.
+void gapless_queue(Mix_Chunk *c, const char *path);
+// Go on to the queued song right now. Returns 0 if there is none.
+int gapless_skip(void);
+void gapless_stop(void);
+
+int gapless_playing(void);
+const char *gapless_current(void);
+const char *gapless_queued(void);
+
+void gapless_volume(int volume); // 0 to MIX_MAX_VOLUME
+void gapless_seek(double seconds);
+double gapless_position(void);   // In seconds
+
+// What happened since the last call, one event at a time.
+Gapless_Event gapless_poll(void);
+
+#endif // GAPLESS_H
@@ -0,0 +1,54 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <time.h>
+#include <sys/types.h>
+
+#include "dyn_array.h"
+#include "ds/array.h"
+#include "ds/strmap.h"
+
+// The library index remembers the contents of every directory that
+// has been scanned together with its modification time. A directory
+// whose mtime did not change since the last scan does not need
+// to be read again.
+
+typedef struct {
+        char          *name;
+        unsigned char  type; // DT_REG or DT_DIR
+        dev_t          dev;  // Only known for files
+        ino_t          ino;
+} Index_Entry;
+
+DYN_ARRAY_TYPE(Index_Entry, Index_Entry_Array);
+
+typedef struct {
+        char              *path;
+        struct timespec    mtime;
+        Index_Entry_Array  entries; // Sorted by name
+        int                seen;    // Visited by the current scan
+        int                dead;    // The directory no longer exists
+} Index_Dir;
+
+DYN_ARRAY_TYPE(Index_Dir *, Index_Dir_Array);
+
+typedef struct {
+        char            *fp;
+        char            *buf;     // Contents of the index file, records point into it
+        Str_Array        strs;    // Strings allocated after loading
+        Index_Dir_Array  dirs;
+        Str_Map          map;     // path -> Index_Dir *
+        time_t           started; // When the index was loaded
+        int              dirty;
+} Index;
+
+Index index_load(const char *fp);
+Index_Dir *index_get(Index *idx, const char *path);
+Index_Dir *index_put(Index *idx, const char *path, struct timespec mtime);
+void index_dir_add(Index *idx, Index_Dir *d, const char *name, unsigned char type, dev_t dev, ino_t ino);
+void index_seen(Index *idx, const char *path);
+void index_prune(Index *idx, const char *root);
+void index_save(Index *idx);
+void index_free(Index *idx);
+
+#endif // INDEX_H
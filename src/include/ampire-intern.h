@@ -0,0 +1,31 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+#include "ds/array.h"
+
+// Every song path is kept once, however many playlists it is in,
+// so two paths are the same song exactly when they are the same
+// pointer. Each one counts who holds on to it: every call that
+// returns an interned string gives the caller a reference, and
+// the string goes away when the last one is given back.
+
+char *intern(const char *s);
+// The same for the `n` characters at `s`, which need not end in a NUL.
+char *intern_n(const char *s, size_t n);
+// `dir` and `name` joined with a '/'.
+char *intern_path(const char *dir, const char *name);
+// The interned copy of `s`, or NULL if nobody holds it. This
+// does not give a reference, so only compare the result.
+char *intern_find(const char *s);
+
+// Another reference to the interned string `s`, which is returned.
+// NULL is passed through.
+char *intern_ref(char *s);
+// Give back a reference to `s`. Nothing happens for NULL.
+void intern_unref(const char *s);
+// Give back a reference to every string in `songfps`.
+void intern_unref_all(const Str_Array *songfps);
+
+#endif // INTERN_H
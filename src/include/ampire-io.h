@@ -5,10 +5,22 @@
 #include "ampire-display.h"
 
 Playlist_Array io_flatten_dirs(const Str_Array *dirs);
+Playlist_Array io_scan_dirs(const Str_Array *dirs);
+// The saved playlists, without their songs yet.
 Playlist_Array io_read_config_file(void);
+// Fill in the songs of a playlist from io_read_config_file().
+void io_load_playlist(Playlist *p);
 void io_write_to_config_file(const char *pname, const Str_Array *filepaths);
 void io_clear_config_file(void);
 int io_del_playlist(const char *pname);
 int io_replace_playlist_songs(const char *pname, const Str_Array *songfps);
+int io_rename_playlist(const char *pname, const char *newname);
+// Saving happens in the background. Returns 1 while there is
+// something left to write, with how far along it is in bytes.
+int io_saving(size_t *done, size_t *total);
+// Did writing a save fail since the last call?
+int io_save_failed(void);
+// Wait for the saved playlists to be written out.
+void io_finish(void);
 
 #endif // IO_H
@@ -0,0 +1,21 @@
+#ifndef M3U_H
+#define M3U_H
+
+#include "ds/array.h"
+
+// Playlist files made by other programs: M3U, M3U8 and PLS.
+
+// Does `fp` end like a playlist file?
+int m3u_is_playlist(const char *fp);
+
+// Append the songs in the playlist file `fp` to `out`, interned.
+// Paths that are not absolute are taken as relative to the directory
+// of `fp`, which has to be absolute. Returns 0 if the file could not
+// be read.
+int m3u_read(const char *fp, Str_Array *out);
+
+// Write `songfps` to `fp`, as PLS if it ends in .pls and as
+// M3U otherwise. Returns 0 on failure.
+int m3u_write(const char *fp, const Str_Array *songfps);
+
+#endif // M3U_H
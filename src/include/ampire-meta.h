@@ -0,0 +1,73 @@
+#ifndef META_H
+#define META_H
+
+#include <stdint.h>
+
+#include "dyn_array.h"
+#include "ds/array.h"
+#include "ds/arena.h"
+
+DYN_ARRAY_TYPE(int, Int_Array);
+
+// What could be read from the tags of a single file.
+typedef struct {
+        char *title;    // NULL if not known
+        char *artist;
+        char *album;
+        int   trackno;  // 0 if not known
+        int   duration; // In seconds, -1 if not known
+} Meta;
+
+// Read the tags (ID3v2, ID3v1, Vorbis comments, OpusTags or RIFF INFO)
+// and the duration of the file at `path`. Only the headers are read.
+// Returns 0 if the file could not be opened or is not in a known format.
+int meta_read(const char *path, Meta *out);
+void meta_clear(Meta *m);
+
+// The tags of every song in a playlist, one column per field and
+// indexed the same way as the songs. The strings live in an arena.
+typedef struct {
+        Str_Array titles;
+        Str_Array artists;
+        Str_Array albums;
+        Int_Array tracknos;
+        Int_Array durations;
+} Meta_Store;
+
+Meta_Store meta_store_create(void);
+// Add a row of unknown tags for a new song.
+void meta_store_append(Meta_Store *ms);
+// Remove every row `i` with `rm[i]` set, in one pass.
+void meta_store_filter(Meta_Store *ms, const uint8_t *rm);
+void meta_store_set(Meta_Store *ms, size_t idx, const Meta *m, Arena *arena);
+void meta_store_free(Meta_Store *ms);
+
+typedef struct {
+        void       *owner; // What was passed to meta_request()
+        const char *path;
+        size_t      idx;   // Index of the song when it was requested
+        Meta        meta;
+} Meta_Result;
+
+DYN_ARRAY_TYPE(Meta_Result, Meta_Result_Array);
+
+// A pool of threads reading tags in the background.
+typedef struct Meta_Pipeline Meta_Pipeline;
+
+Meta_Pipeline *meta_pipeline_create(void);
+
+// Queue the songs `paths[from..]` for reading. The paths have to be
+// interned, every request holds a reference that goes with its result.
+void meta_request(Meta_Pipeline *p, void *owner, const Str_Array *paths, size_t from);
+
+// Append everything that was read since the last call to `out`
+// without blocking. The caller owns the strings in the results,
+// and has to give back the reference to `path` with intern_unref().
+void meta_poll(Meta_Pipeline *p, Meta_Result_Array *out);
+
+// Number of songs still waiting to be read.
+size_t meta_pending(Meta_Pipeline *p);
+
+void meta_pipeline_free(Meta_Pipeline *p);
+
+#endif // META_H
@@ -0,0 +1,33 @@
+#ifndef PRELOAD_H
+#define PRELOAD_H
+
+#include <SDL3_mixer/SDL_mixer.h>
+
+// Decodes the song that plays next on a thread of its own while the
+// current one is playing, for the gapless player (ampire-gapless.h).
+typedef struct Preloader Preloader;
+
+// Songs that decode to more than this are left to Mix_LoadMUS(),
+// which does not keep all of it in memory. About 25 minutes of
+// 16 bit stereo at 44.1 kHz.
+#define PRELOAD_MAX_BYTES (256u * 1024 * 1024)
+
+// Bits per second of the most compressed song we expect, to guess
+// how long a song is from its file size when the tags do not tell.
+#define PRELOAD_MIN_BITRATE 64000u
+
+Preloader *preload_create(void);
+// Start loading `path`, dropping whatever was loaded before.
+// Nothing happens if `path` is what is loaded already. Paths are
+// compared by pointer, so they have to be interned, the preloader
+// keeps a reference of its own for as long as it needs one. `secs` is how
+// long the song is, or -1 if that is not known. Songs that would
+// be too big are not decoded at all.
+void preload_request(Preloader *p, const char *path, int secs);
+// The decoded `path`, or NULL if it is not done yet, something else
+// was loaded or it could not be loaded. Never waits. The caller owns
+// the chunk that is returned.
+Mix_Chunk *preload_take(Preloader *p, const char *path);
+void preload_free(Preloader *p);
+
+#endif // PRELOAD_H
@@ -0,0 +1,64 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include "dyn_array.h"
+#include "ds/array.h"
+
+// A scan of one or more directory trees running in the background.
+// The trees are read by a pool of worker threads, but the resulting
+// order is always the same: entries sorted by name, depth first.
+// Subdirectories are followed if FT_RECURSIVE is set.
+typedef struct Scan Scan;
+
+// Used where a root index is expected but there is none.
+#define SCAN_NO_ROOT ((size_t)-1)
+
+// A directory that scan_drain() passed through.
+typedef struct {
+        char *path;
+        void *node; // For scan_recheck(), only valid until scan_free()
+} Scan_Dir;
+
+DYN_ARRAY_TYPE(Scan_Dir, Scan_Dir_Array);
+
+// Start scanning every directory in `roots` (absolute paths).
+// If `indexfp` is not NULL, directories that did not change since
+// they were last indexed are not read again, and the index is
+// updated once the scan is done.
+Scan *scan_start(const Str_Array *roots, const char *indexfp);
+
+// Append the music files of the root `root` that are known by now
+// to `out`, continuing where the last call left off. The paths are
+// interned if `interned` is set, and malloc()'d if not. If `dirs` is not
+// NULL, every directory that was passed through is appended to it,
+// the caller owns the paths. Returns 1 once everything below the root
+// has been handed out.
+int scan_drain(Scan *s, size_t root, int interned, Str_Array *out, Scan_Dir_Array *dirs);
+
+// Read the directory `d` again if it may have changed since the scan
+// read it, and append the music files that are new to `out` (see
+// scan_drain() for `interned`) and the new subdirectories to `subdirs`
+// (malloc()'d). Meant to be called right after starting to watch `d`,
+// so that nothing created in between goes unnoticed.
+void scan_recheck(Scan *s, const Scan_Dir *d, int interned, Str_Array *out, Str_Array *subdirs);
+
+int scan_finished(Scan *s);
+size_t scan_ndirs(Scan *s);
+size_t scan_nfiles(Scan *s);
+// Number of files that were skipped because they are not in a playable format.
+size_t scan_nbad(Scan *s);
+
+// Block until the scan is done.
+void scan_wait(Scan *s);
+
+// Cancel the scan if it is still running, and free it.
+void scan_free(Scan *s);
+
+// Tell by the extension if `fp` might be a song.
+int is_music_f(const char *fp);
+
+// Tell by the first few bytes if the file `name` (relative to
+// `dirfd`, or AT_FDCWD) is WAV, Ogg (Vorbis/Opus) or MP3.
+int is_music_content(int dirfd, const char *name);
+
+#endif // SCAN_H
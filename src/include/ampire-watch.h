@@ -0,0 +1,51 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "dyn_array.h"
+#include "ds/array.h"
+
+typedef enum {
+        WATCH_ADD,        // A music file appeared at `path`
+        WATCH_REMOVE,     // The music file at `path` is gone
+        WATCH_RENAME,     // The music file `path` is now at `newpath`
+        WATCH_REMOVE_DIR, // Everything below the directory `path` is gone
+        WATCH_RENAME_DIR, // The directory `path` is now at `newpath`
+        WATCH_ADD_DIR,    // The directory `path` appeared and has to be scanned
+} Watch_Event_Kind;
+
+typedef struct {
+        Watch_Event_Kind  kind;
+        void             *owner;   // What was passed to watch_add()
+        char             *path;
+        char             *newpath; // Only set for renames
+} Watch_Event;
+
+DYN_ARRAY_TYPE(Watch_Event, Watch_Event_Array);
+
+typedef struct {
+        char *path; // NULL if the watch was removed
+        void *owner;
+} Watch_Dir;
+
+DYN_ARRAY_TYPE(Watch_Dir, Watch_Dir_Array);
+
+typedef struct {
+        int              fd;
+        Watch_Dir_Array  dirs; // Indexed by the inotify watch descriptor
+        int              full; // Ran out of inotify watches
+} Watcher;
+
+int watch_init(Watcher *w);
+
+// Start watching the directory `dir`. Events for files inside of it
+// are tagged with `owner`. New subdirectories are watched as well
+// if FT_RECURSIVE is set.
+int watch_add(Watcher *w, const char *dir, void *owner);
+
+// Read whatever events are ready without blocking and append
+// them to `out`. The caller owns the paths in the events.
+void watch_poll(Watcher *w, Watch_Event_Array *out);
+
+void watch_free(Watcher *w);
+
+#endif // WATCH_H
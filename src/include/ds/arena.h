@@ -0,0 +1,28 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_CHUNK_SZ (64 * 1024)
+
+typedef struct __Arena_Chunk {
+        struct __Arena_Chunk *next;
+        size_t len;
+        size_t cap;
+        char data[];
+} __Arena_Chunk;
+
+// Strings that live as long as the arena. Nothing
+// is freed on its own, only the whole arena at once.
+typedef struct {
+        __Arena_Chunk *head;
+} Arena;
+
+Arena *arena_create(void);
+void *arena_alloc(Arena *a, size_t n);
+char *arena_strdup(Arena *a, const char *s);
+// The first `n` characters of `s`, which need not end in a NUL.
+char *arena_strndup(Arena *a, const char *s, size_t n);
+void arena_free(Arena *a);
+
+#endif // ARENA_H
@@ -7,5 +7,6 @@
 
 DYN_ARRAY_TYPE(char *, Str_Array);
 DYN_ARRAY_TYPE(size_t, Size_T_Array);
+DYN_DEQUE_TYPE(size_t, Size_T_Deque);
 
 #endif // ARRAY_H
@@ -4,30 +4,46 @@
 #include <stdint.h>
 #include <stddef.h>
 
-#define STRMAP_INIT_CAP 1024
+#include "ds/arena.h"
+
+// Open addressing, the slots are looked at 16 at a time. Every slot
+// has a control byte: STRMAP_EMPTY, or the low 7 bits of the hash of
+// its key, so most slots that do not match are skipped without
+// looking at the key. The full hash is kept too for growing.
+// The keys are copied into an arena and never move.
+
+#define STRMAP_INIT_CAP 1024 // Slots, a power of two
+#define STRMAP_GROUP    16
+#define STRMAP_EMPTY    0x80
 
 typedef unsigned long (*strmap_hash_sig)(const char *k);
 typedef void (*strmap_destroy_val_sig)(uint8_t *v);
 
-typedef struct __Str_Map_Node {
+typedef struct {
         char *k;
         uint8_t *v;
-        struct __Str_Map_Node *n;
-} __Str_Map_Node;
+        uint64_t hash;
+} __Str_Map_Slot;
 
 typedef struct {
         struct {
-                __Str_Map_Node **buckets;
+                uint8_t *ctrl;
+                __Str_Map_Slot *slots;
                 size_t len;
                 size_t cap;
         } tbl;
+        Arena *keys;
         strmap_hash_sig hash;
         strmap_destroy_val_sig destroy;
 } Str_Map;
 
 Str_Map strmap_create(strmap_hash_sig hash, strmap_destroy_val_sig destroy);
-void strmap_insert(Str_Map *map, char *k, uint8_t *v);
+// If `k` is in there already, its value is destroyed and replaced.
+// Returns the map's own copy of `k`.
+char *strmap_insert(Str_Map *map, char *k, uint8_t *v);
 uint8_t *strmap_get(Str_Map *m, const char *k);
+// The map's own copy of the key `k`, or NULL if it is not in there.
+char *strmap_key(Str_Map *m, const char *k);
 int strmap_contains(Str_Map *m, const char *k);
 void strmap_free(Str_Map *m);
 size_t strmap_len(const Str_Map *m);
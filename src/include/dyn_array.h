@@ -99,6 +99,41 @@
         (da).data[(da).len++] = (value);                                \
     } while (0)
 
+//////////////////////////////////////////////////
+// Make room for `n` elements in total, so that
+// appending up to there does not reallocate.
+// Example:
+//   dyn_array(int, int_vector);
+//   dyn_array_reserve(int_vector, 100);
+#define dyn_array_reserve(da, n)                                        \
+    do {                                                                \
+        size_t __want_ = (n);                                           \
+        if ((da).cap < __want_) {                                       \
+            (da).cap = __want_;                                         \
+            (da).data = (typeof(*((da).data)) *)                        \
+                realloc((da).data, (da).cap * sizeof(*((da).data)));    \
+        }                                                               \
+    } while (0)
+
+//////////////////////////////////////////////////
+// Append the `n` elements at `src` with one copy.
+// Example:
+//   int xs[] = {1, 2, 3};
+//   dyn_array(int, int_vector);
+//   dyn_array_append_n(int_vector, xs, 3);
+#define dyn_array_append_n(da, src, n)                                  \
+    do {                                                                \
+        size_t __n_ = (n);                                              \
+        if ((da).len + __n_ > (da).cap) {                               \
+            size_t __cap_ = (da).cap * 2;                               \
+            dyn_array_reserve(da, __cap_ > (da).len + __n_              \
+                              ? __cap_ : (da).len + __n_);              \
+        }                                                               \
+        if (__n_) memcpy((da).data + (da).len, (src),                   \
+                         __n_ * sizeof(*((da).data)));                  \
+        (da).len += __n_;                                               \
+    } while (0)
+
 //////////////////////////////////////////////////
 // Free a dynamic array.
 // Example:
@@ -146,15 +181,150 @@
 //   dyn_array_rm_at(int_vector, 0);
 //   dyn_array_rm_at(int_vector, 5);
 //   ...
-#define dyn_array_rm_at(da, idx) \
-    do {                                                     \
-        for (size_t __i_ = (idx); __i_ < (da).len-1; ++__i_) \
-            (da).data[__i_] = (da).data[__i_+1];             \
-        (da).len--;                                          \
+#define dyn_array_rm_at(da, idx) dyn_array_rm_range(da, idx, 1)
+
+//////////////////////////////////////////////////
+// Remove the `n` elements starting at `idx`,
+// everything after them is moved down at once.
+// Example:
+//   dyn_array(int, int_vector);
+//   ...
+//   dyn_array_rm_range(int_vector, 2, 3);
+#define dyn_array_rm_range(da, idx, n)                                  \
+    do {                                                                \
+        size_t __at_ = (idx), __n_ = (n);                               \
+        memmove((da).data + __at_, (da).data + __at_ + __n_,            \
+                ((da).len - __at_ - __n_) * sizeof(*(da).data));        \
+        (da).len -= __n_;                                               \
+    } while (0)
+
+//////////////////////////////////////////////////
+// Remove the element at `idx` by moving the last
+// one into its place. The order is not kept.
+// Example:
+//   dyn_array(int, int_vector);
+//   ...
+//   dyn_array_swap_rm(int_vector, 0);
+#define dyn_array_swap_rm(da, idx)                      \
+    do {                                                \
+        (da).data[idx] = (da).data[(da).len-1];         \
+        (da).len--;                                     \
+    } while (0)
+
+//////////////////////////////////////////////////
+// Keep only the elements for which `keep` is true,
+// in order, in a single pass. `keep` can use the
+// index `i`, which is still the old index, so it
+// can look at other arrays kept in step.
+// Example:
+//   dyn_array(int, int_vector);
+//   ...
+//   dyn_array_filter(int_vector, i, int_vector.data[i] % 2 == 0);
+#define dyn_array_filter(da, i, keep)                           \
+    do {                                                        \
+        size_t __len_ = 0;                                      \
+        for (size_t i = 0; i < (da).len; ++i) {                 \
+            if (keep) (da).data[__len_++] = (da).data[i];       \
+        }                                                       \
+        (da).len = __len_;                                      \
     } while (0)
 
 #define dyn_array_explode(da) (da).data, (da).len, (da).cap
 
 #define dyn_array_explode_mem(da) &(da).data, &(da).len, &(da).cap
 
+//////////////////////////////////////////////////
+// Creates a new double ended queue type globally.
+// It is a ring buffer, so pushing and popping at
+// either end does not move the other elements.
+// The capacity is always a power of two.
+// Example:
+//   DYN_DEQUE_TYPE(int, Int_Deque);
+//
+//   Int_Deque dq = dyn_deque_empty(Int_Deque);
+//   dyn_deque_push_back(dq, 1);
+//   dyn_deque_push_front(dq, 0);
+//   printf("%d\n", dyn_deque_at(dq, 1)); // 1
+//   dyn_deque_pop_front(dq);
+//   dyn_deque_free(dq);
+#define DYN_DEQUE_TYPE(ty, name) \
+    typedef struct {             \
+        ty *data;                \
+        size_t head, len, cap;   \
+    } name
+
+#define dyn_deque_empty(dq_ty)                  \
+        (dq_ty) {                               \
+                .data = NULL,                   \
+                .head = 0,                      \
+                .len = 0,                       \
+                .cap = 0,                       \
+        }
+
+//////////////////////////////////////////////////
+// The element `i` places from the front.
+// Example:
+//   dyn_deque_at(dq, 0) = 5;
+#define dyn_deque_at(dq, i) ((dq).data[((dq).head + (i)) & ((dq).cap - 1)])
+
+#define dyn_deque_front(dq) dyn_deque_at(dq, 0)
+
+#define dyn_deque_back(dq) dyn_deque_at(dq, (dq).len - 1)
+
+// Double the capacity if it is full. The elements
+// are copied over in order, starting at 0.
+#define __dyn_deque_reserve_one(dq)                                           \
+    do {                                                                      \
+        if ((dq).len >= (dq).cap) {                                           \
+            size_t __cap_ = (dq).cap ? (dq).cap * 2 : 8;                      \
+            typeof((dq).data) __data_ = malloc(__cap_ * sizeof(*(dq).data));  \
+            for (size_t __i_ = 0; __i_ < (dq).len; ++__i_)                    \
+                __data_[__i_] = dyn_deque_at(dq, __i_);                       \
+            free((dq).data);                                                  \
+            (dq).data = __data_;                                              \
+            (dq).head = 0;                                                    \
+            (dq).cap = __cap_;                                                \
+        }                                                                     \
+    } while (0)
+
+#define dyn_deque_push_back(dq, value)          \
+    do {                                        \
+        __dyn_deque_reserve_one(dq);            \
+        dyn_deque_at(dq, (dq).len) = (value);   \
+        (dq).len++;                             \
+    } while (0)
+
+#define dyn_deque_push_front(dq, value)                          \
+    do {                                                         \
+        __dyn_deque_reserve_one(dq);                             \
+        (dq).head = ((dq).head + (dq).cap - 1) & ((dq).cap - 1); \
+        (dq).data[(dq).head] = (value);                          \
+        (dq).len++;                                              \
+    } while (0)
+
+//////////////////////////////////////////////////
+// Drop the first element, it must not be empty.
+#define dyn_deque_pop_front(dq)                             \
+    do {                                                    \
+        (dq).head = ((dq).head + 1) & ((dq).cap - 1);       \
+        (dq).len--;                                         \
+    } while (0)
+
+//////////////////////////////////////////////////
+// Drop the last element, it must not be empty.
+#define dyn_deque_pop_back(dq) (dq).len--
+
+#define dyn_deque_clear(dq) \
+    do {                    \
+        (dq).head = 0;      \
+        (dq).len = 0;       \
+    } while (0)
+
+#define dyn_deque_free(dq)                              \
+    do {                                                \
+        free((dq).data);                                \
+        (dq).data = NULL;                               \
+        (dq).head = (dq).len = (dq).cap = 0;            \
+    } while (0)
+
 #endif // DYN_ARRAY_H
@@ -0,0 +1,239 @@
+// MIT License
+
+// Copyright (c) 2025 malloc-nbytes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/* Hash sets and maps to go with dyn_array.h, for keys that can
+ * be compared with == and cast to an integer: integers and pointers.
+ * Strings go in Str_Map. */
+
+#ifndef DYN_HASH_H
+#define DYN_HASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Linear probing over a power of two of slots, at most 3/4 full.
+// Removing shifts the entries after it back, so there are no
+// tombstones and a lookup stops at the first unused slot.
+
+static inline size_t dyn_hash_u64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+#define __dyn_hash_key(k) dyn_hash_u64((uint64_t)(uintptr_t)(k))
+
+// Should the entry in slot `j`, which hashes to `h`, move to the
+// free slot `i`? Only if `h` is not in (i, j], going around.
+#define __dyn_hash_moves(i, j, h) \
+    ((i) <= (j) ? ((h) <= (i) || (h) > (j)) : ((h) <= (i) && (h) > (j)))
+
+//////////////////////////////////////////////////
+// An empty set or map, nothing is allocated
+// until the first insert.
+// Example:
+//   Int_Set set = dyn_hash_empty(Int_Set);
+#define dyn_hash_empty(ty) ((ty) {0})
+
+//////////////////////////////////////////////////
+// Creates a hash set type and its functions, which
+// are all prefixed with the name of the type.
+// Example:
+//   DYN_HASHSET_TYPE(int, Int_Set);
+//
+//   Int_Set set = dyn_hash_empty(Int_Set);
+//   Int_Set_insert(&set, 3);
+//   if (Int_Set_contains(&set, 3)) ...
+//   Int_Set_remove(&set, 3);
+//   Int_Set_free(&set);
+#define DYN_HASHSET_TYPE(kty, name)                                         \
+    typedef struct {                                                        \
+        kty *keys;                                                          \
+        uint8_t *used;                                                      \
+        size_t len, cap;                                                    \
+    } name;                                                                 \
+                                                                            \
+    static inline size_t name##_slot(const name *s, kty k) {                \
+        size_t mask = s->cap - 1, i = __dyn_hash_key(k) & mask;             \
+        while (s->used[i] && s->keys[i] != k) i = (i + 1) & mask;           \
+        return i;                                                           \
+    }                                                                       \
+                                                                            \
+    static inline int name##_contains(const name *s, kty k) {               \
+        return s->len > 0 && s->used[name##_slot(s, k)];                    \
+    }                                                                       \
+                                                                            \
+    static inline void name##_grow(name *s) {                               \
+        name old = *s;                                                      \
+        s->cap = old.cap ? old.cap * 2 : 16;                                \
+        s->keys = malloc(s->cap * sizeof(kty));                             \
+        s->used = calloc(s->cap, 1);                                        \
+        for (size_t __i_ = 0; __i_ < old.cap; ++__i_) {                     \
+            if (!old.used[__i_]) continue;                                  \
+            size_t __j_ = name##_slot(s, old.keys[__i_]);                   \
+            s->used[__j_] = 1;                                              \
+            s->keys[__j_] = old.keys[__i_];                                 \
+        }                                                                   \
+        free(old.keys);                                                     \
+        free(old.used);                                                     \
+    }                                                                       \
+                                                                            \
+    /* Returns 0 if `k` was in there already. */                            \
+    static inline int name##_insert(name *s, kty k) {                       \
+        if ((s->len + 1) * 4 > s->cap * 3) name##_grow(s);                  \
+        size_t i = name##_slot(s, k);                                       \
+        if (s->used[i]) return 0;                                           \
+        s->used[i] = 1;                                                     \
+        s->keys[i] = k;                                                     \
+        s->len++;                                                           \
+        return 1;                                                           \
+    }                                                                       \
+                                                                            \
+    /* Returns 0 if `k` was not in there. */                                \
+    static inline int name##_remove(name *s, kty k) {                       \
+        if (s->len == 0) return 0;                                          \
+        size_t mask = s->cap - 1, i = name##_slot(s, k);                    \
+        if (!s->used[i]) return 0;                                          \
+        for (size_t j = (i + 1) & mask; s->used[j]; j = (j + 1) & mask) {   \
+            size_t h = __dyn_hash_key(s->keys[j]) & mask;                   \
+            if (__dyn_hash_moves(i, j, h)) {                                \
+                s->keys[i] = s->keys[j];                                    \
+                i = j;                                                      \
+            }                                                               \
+        }                                                                   \
+        s->used[i] = 0;                                                     \
+        s->len--;                                                           \
+        return 1;                                                           \
+    }                                                                       \
+                                                                            \
+    static inline void name##_clear(name *s) {                              \
+        if (s->cap) memset(s->used, 0, s->cap);                             \
+        s->len = 0;                                                         \
+    }                                                                       \
+                                                                            \
+    static inline void name##_free(name *s) {                               \
+        free(s->keys);                                                      \
+        free(s->used);                                                      \
+        *s = dyn_hash_empty(name);                                          \
+    }
+
+//////////////////////////////////////////////////
+// Creates a hash map type and its functions, which
+// are all prefixed with the name of the type.
+// Example:
+//   DYN_HASHMAP_TYPE(size_t, int, Size_T_Int_Map);
+//
+//   Size_T_Int_Map map = dyn_hash_empty(Size_T_Int_Map);
+//   Size_T_Int_Map_put(&map, 3, 42);
+//   int *v = Size_T_Int_Map_get(&map, 3); // NULL if it is not in there
+//   Size_T_Int_Map_remove(&map, 3);
+//   Size_T_Int_Map_free(&map);
+#define DYN_HASHMAP_TYPE(kty, vty, name)                                    \
+    typedef struct {                                                        \
+        kty *keys;                                                          \
+        vty *vals;                                                          \
+        uint8_t *used;                                                      \
+        size_t len, cap;                                                    \
+    } name;                                                                 \
+                                                                            \
+    static inline size_t name##_slot(const name *m, kty k) {                \
+        size_t mask = m->cap - 1, i = __dyn_hash_key(k) & mask;             \
+        while (m->used[i] && m->keys[i] != k) i = (i + 1) & mask;           \
+        return i;                                                           \
+    }                                                                       \
+                                                                            \
+    /* Valid until the next put() or remove(). */                           \
+    static inline vty *name##_get(const name *m, kty k) {                   \
+        if (m->len == 0) return NULL;                                       \
+        size_t i = name##_slot(m, k);                                       \
+        return m->used[i] ? &m->vals[i] : NULL;                             \
+    }                                                                       \
+                                                                            \
+    static inline int name##_contains(const name *m, kty k) {               \
+        return name##_get(m, k) != NULL;                                    \
+    }                                                                       \
+                                                                            \
+    static inline void name##_grow(name *m) {                               \
+        name old = *m;                                                      \
+        m->cap = old.cap ? old.cap * 2 : 16;                                \
+        m->keys = malloc(m->cap * sizeof(kty));                             \
+        m->vals = malloc(m->cap * sizeof(vty));                             \
+        m->used = calloc(m->cap, 1);                                        \
+        for (size_t __i_ = 0; __i_ < old.cap; ++__i_) {                     \
+            if (!old.used[__i_]) continue;                                  \
+            size_t __j_ = name##_slot(m, old.keys[__i_]);                   \
+            m->used[__j_] = 1;                                              \
+            m->keys[__j_] = old.keys[__i_];                                 \
+            m->vals[__j_] = old.vals[__i_];                                 \
+        }                                                                   \
+        free(old.keys);                                                     \
+        free(old.vals);                                                     \
+        free(old.used);                                                     \
+    }                                                                       \
+                                                                            \
+    /* Set the value of `k`, adding it if it is not in there. */            \
+    static inline vty *name##_put(name *m, kty k, vty v) {                  \
+        if ((m->len + 1) * 4 > m->cap * 3) name##_grow(m);                  \
+        size_t i = name##_slot(m, k);                                       \
+        if (!m->used[i]) {                                                  \
+            m->used[i] = 1;                                                 \
+            m->keys[i] = k;                                                 \
+            m->len++;                                                       \
+        }                                                                   \
+        m->vals[i] = v;                                                     \
+        return &m->vals[i];                                                 \
+    }                                                                       \
+                                                                            \
+    /* Returns 0 if `k` was not in there. */                                \
+    static inline int name##_remove(name *m, kty k) {                       \
+        if (m->len == 0) return 0;                                          \
+        size_t mask = m->cap - 1, i = name##_slot(m, k);                    \
+        if (!m->used[i]) return 0;                                          \
+        for (size_t j = (i + 1) & mask; m->used[j]; j = (j + 1) & mask) {   \
+            size_t h = __dyn_hash_key(m->keys[j]) & mask;                   \
+            if (__dyn_hash_moves(i, j, h)) {                                \
+                m->keys[i] = m->keys[j];                                    \
+                m->vals[i] = m->vals[j];                                    \
+                i = j;                                                      \
+            }                                                               \
+        }                                                                   \
+        m->used[i] = 0;                                                     \
+        m->len--;                                                           \
+        return 1;                                                           \
+    }                                                                       \
+                                                                            \
+    static inline void name##_clear(name *m) {                              \
+        if (m->cap) memset(m->used, 0, m->cap);                             \
+        m->len = 0;                                                         \
+    }                                                                       \
+                                                                            \
+    static inline void name##_free(name *m) {                               \
+        free(m->keys);                                                      \
+        free(m->vals);                                                      \
+        free(m->used);                                                      \
+        *m = dyn_hash_empty(name);                                          \
+    }
+
+#endif // DYN_HASH_H
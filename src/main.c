@@ -11,6 +11,7 @@
 #include "ampire-io.h"
 #include "ampire-display.h"
 #include "ampire-flag.h"
+#include "ampire-filter.h"
 #include "config.h"
 
 #define FLAG_1HY_HELP 'h'
@@ -31,6 +32,10 @@
 #define FLAG_2HY_HISTORY_SZ "history-sz"
 #define FLAG_2HY_ONESHOT "oneshot"
 #define FLAG_2HY_PLAYLIST_SZ "playlist-sz"
+#define FLAG_2HY_WATCH "watch"
+#define FLAG_2HY_DEDUPE "dedupe"
+#define FLAG_2HY_INCLUDE "include"
+#define FLAG_2HY_EXCLUDE "exclude"
 
 struct {
         uint32_t flags;
@@ -51,7 +56,7 @@ struct {
 void usage(void) {
         printf("(MIT License) Copyright (c) 2025 malloc-nbytes\n\n");
         printf("Ampire v" VERSION ", (compiler) " COMPILER_INFO "\n\n");
-        printf("Usage: ampire [dir...] [options...]\n");
+        printf("Usage: ampire [dir|playlist.m3u...] [options...]\n");
         printf("Options:\n");
         printf("    -%c, --%s[=<flag>|*]  print this help message or get help on an individual flag or `*` for all\n", FLAG_1HY_HELP, FLAG_2HY_HELP);
         printf("    -%c, --%s          view version\n", FLAG_1HY_VERSION, FLAG_2HY_VERSION);
@@ -62,6 +67,10 @@ void usage(void) {
         printf("        --%s       print all saved songs\n", FLAG_2HY_SHOW_SAVES);
         printf("        --%s   do not show the logo in the player\n", FLAG_2HY_DISABLE_PLAYER_LOGO);
         printf("        --%s         show the keybinds\n", FLAG_2HY_CONTROLS);
+        printf("        --%s            keep playlists of directories up to date while running\n", FLAG_2HY_WATCH);
+        printf("        --%s           list files reachable through several paths only once\n", FLAG_2HY_DEDUPE);
+        printf("        --%s=g        only add songs whose name matches the glob `g`\n", FLAG_2HY_INCLUDE);
+        printf("        --%s=g        skip files and directories whose name matches the glob `g`\n", FLAG_2HY_EXCLUDE);
         printf("        --%s=v         set the volume as `v` where 0 <= v <= 128 (note: not a percentage)\n", FLAG_2HY_VOLUME);
         printf("        --%s=p       set the playlist to index `p`\n", FLAG_2HY_PLAYLIST);
         printf("        --%s=i     set the history size to `i`\n", FLAG_2HY_HISTORY_SZ);
@@ -81,6 +90,45 @@ static void playlist_sz_info(void) {
         printf("        ampire --playlist-sz=5\n");
 }
 
+static void watch_info(void) {
+        printf("--help(%s):\n", FLAG_2HY_WATCH);
+        printf("    Watch the directory(s) provided for changes while ampire is running.\n");
+        printf("    Songs that are added, removed or renamed show up in the playlist\n");
+        printf("    right away. New songs are added to the end of the playlist.\n");
+        printf("    Note: Use together with -%c to also watch all subdirectories.\n", FLAG_1HY_RECURSIVE);
+        printf("    Example:\n");
+        printf("        ampire --watch -r ~/Music\n");
+}
+
+static void dedupe_info(void) {
+        printf("--help(%s):\n", FLAG_2HY_DEDUPE);
+        printf("    Add every music file to a playlist only once, even if it can be\n");
+        printf("    reached through hard links or symlinks under different names.\n");
+        printf("    The first one in the playlist is kept.\n");
+        printf("    Note: Directories are always only scanned once, this is about files.\n");
+        printf("    Example:\n");
+        printf("        ampire --dedupe -r ~/Music\n");
+}
+
+static void include_info(void) {
+        printf("--help(%s):\n", FLAG_2HY_INCLUDE);
+        printf("    Only add songs whose file name matches the glob. Can be given\n");
+        printf("    more than once, a song has to match any one of them.\n");
+        printf("    Note: This only applies to files, all directories are still searched.\n");
+        printf("    Example:\n");
+        printf("        ampire -r --include='*.opus' --include='live-*' ~/Music\n");
+}
+
+static void exclude_info(void) {
+        printf("--help(%s):\n", FLAG_2HY_EXCLUDE);
+        printf("    Skip files and directories whose name matches the glob. Can be given\n");
+        printf("    more than once. Excluded directories are not read at all, which makes\n");
+        printf("    scanning a lot faster if there are big non-music trees in the way.\n");
+        printf("    Note: The glob is matched against the name only, not the whole path.\n");
+        printf("    Example:\n");
+        printf("        ampire -r --exclude=.git --exclude='*stems*' ~/Music\n");
+}
+
 static void oneshot_info(void) {
         printf("--help(%c, %s):\n", FLAG_1HY_ONESHOT, FLAG_2HY_ONESHOT);
         printf("    Play a single music file without the TUI.\n");
@@ -142,8 +190,8 @@ static void show_saves_info(void) {
 
 static void clear_info(void) {
         printf("--help(%c, %s):\n", FLAG_1HY_CLR_SAVED_SONGS, FLAG_2HY_CLR_SAVED_SONGS);
-        printf("    All saved playlists gets saved in `/home/$USER/.ampire`.\n");
-        printf("    If you want to reset this file, you can call this flag to clear it.\n");
+        printf("    All saved playlists gets saved in `/home/$USER/.ampire.d`.\n");
+        printf("    If you want to remove them all, you can call this flag to clear it.\n");
         printf("    Note: ampire will exit upon invocation of this flag.\n");
 }
 
@@ -201,6 +249,10 @@ static void show_help_for_flag(const char *flag) {
                 history_sz_info,
                 oneshot_info,
                 playlist_sz_info,
+                watch_info,
+                dedupe_info,
+                include_info,
+                exclude_info,
         };
 
 #define OHYEQ(n, flag, actual) ((n) == 1 && (flag)[0] == (actual))
@@ -235,6 +287,14 @@ static void show_help_for_flag(const char *flag) {
                 help[11]();
         } else if (!strcmp(flag, FLAG_2HY_PLAYLIST_SZ)) {
                 help[12]();
+        } else if (!strcmp(flag, FLAG_2HY_WATCH)) {
+                help[13]();
+        } else if (!strcmp(flag, FLAG_2HY_DEDUPE)) {
+                help[14]();
+        } else if (!strcmp(flag, FLAG_2HY_INCLUDE)) {
+                help[15]();
+        } else if (!strcmp(flag, FLAG_2HY_EXCLUDE)) {
+                help[16]();
         } else {
                 fprintf(stderr, "help(%s) info does not exist\n", flag);
                 if (*flag == '-') {
@@ -265,6 +325,8 @@ static void controls(void) {
         printf("| [ n ]               | Search for next match                                     |\n");
         printf("| [ N ]               | Search for previous match                                 |\n");
         printf("| [ d ]               | Delete song list                                          |\n");
+        printf("| [ r ]               | Rename song list                                          |\n");
+        printf("| [ e ]               | Export song list as M3U or PLS                            |\n");
         printf("| [ g ]               | Jump to first song                                        |\n");
         printf("| [ G ]               | Jump to last song                                         |\n");
         printf("| [ ! ]               | Remove duplicate tracks from playlist                     |\n");
@@ -338,6 +400,16 @@ int main(int argc, char **argv) {
                         g_config.flags |= FT_ONESHOT;
                 } else if (arg.hyphc == 2 && !strcmp(arg.start, FLAG_2HY_ONESHOT)) {
                         g_config.flags |= FT_ONESHOT;
+                } else if (arg.hyphc == 2 && !strcmp(arg.start, FLAG_2HY_WATCH)) {
+                        g_config.flags |= FT_WATCH;
+                } else if (arg.hyphc == 2 && !strcmp(arg.start, FLAG_2HY_DEDUPE)) {
+                        g_config.flags |= FT_DEDUPE;
+                } else if (arg.hyphc == 2 && !strcmp(arg.start, FLAG_2HY_INCLUDE)) {
+                        if (!arg.eq || !*arg.eq) err("--include expects a glob after equals (=)\n");
+                        filter_include(arg.eq);
+                } else if (arg.hyphc == 2 && !strcmp(arg.start, FLAG_2HY_EXCLUDE)) {
+                        if (!arg.eq || !*arg.eq) err("--exclude expects a glob after equals (=)\n");
+                        filter_exclude(arg.eq);
                 } else if (arg.hyphc > 0) {
                         err_wargs("invalid flag: %s", arg.start);
                 } else {
@@ -354,7 +426,10 @@ int main(int argc, char **argv) {
         }
 
         Playlist_Array playlists = io_read_config_file();
-        Playlist_Array cli_playlists = io_flatten_dirs(&dirs);
+        // Only the TUI can show songs while they are still being found.
+        Playlist_Array cli_playlists = (g_config.flags & FT_ONESHOT)
+                ? io_flatten_dirs(&dirs)
+                : io_scan_dirs(&dirs);
 
         // If the user just wants to clear the saved songs
         // and don't provide any music to open.
@@ -369,8 +444,12 @@ int main(int argc, char **argv) {
         }
 
         run(&playlists);
+        io_finish();
 
-        // TODO: memory free().
+        // run() gave back what the playlists had.
+        dyn_array_free(playlists);
+        dyn_array_free(cli_playlists);
+        dyn_array_free(dirs);
 
         return 0;
 }
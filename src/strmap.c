@@ -2,6 +2,12 @@
 #include <string.h>
 #include <stdlib.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "ds/strmap.h"
 #include "ampire-utils.h"
 
@@ -9,48 +15,140 @@ static void strmap_default_val_free(uint8_t *v) {
         free(v);
 }
 
+// The hash functions we are given are not good in every bit,
+// but the low ones pick the control byte and the rest the group.
+static uint64_t strmap_mix(unsigned long h) {
+        uint64_t x = h;
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        return x;
+}
+
+// Bit i is set if ctrl[i] == b, for a group of STRMAP_GROUP.
+static inline uint32_t group_match(const uint8_t *ctrl, uint8_t b) {
+#if defined(__SSE2__)
+        __m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)b)));
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+        static const uint8_t bit[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+        uint8x16_t eq = vandq_u8(vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(b)), vld1q_u8(bit));
+        return (uint32_t)vaddv_u8(vget_low_u8(eq)) | ((uint32_t)vaddv_u8(vget_high_u8(eq)) << 8);
+#else
+        uint32_t res = 0;
+        for (int i = 0; i < STRMAP_GROUP; ++i) {
+                res |= (uint32_t)(ctrl[i] == b) << i;
+        }
+        return res;
+#endif
+}
+
+static void strmap_alloc(Str_Map *m, size_t cap) {
+        m->tbl.ctrl = malloc(cap);
+        memset(m->tbl.ctrl, STRMAP_EMPTY, cap);
+        m->tbl.slots = malloc(cap * sizeof(__Str_Map_Slot));
+        m->tbl.len = 0;
+        m->tbl.cap = cap;
+}
+
 Str_Map strmap_create(strmap_hash_sig hash, strmap_destroy_val_sig destroy) {
-        return (Str_Map) {
-                .tbl = {
-                        .buckets = malloc(sizeof(__Str_Map_Node *) * STRMAP_INIT_CAP),
-                        .len = 0,
-                        .cap = STRMAP_INIT_CAP,
-                },
+        Str_Map m = {
+                .keys = arena_create(),
                 .hash = hash ? hash : djb2,
                 .destroy = destroy ? destroy : strmap_default_val_free,
         };
+        strmap_alloc(&m, STRMAP_INIT_CAP);
+        return m;
 }
 
-void strmap_insert(Str_Map *m, char *k, uint8_t *v) {
-        if (!m || !k) return;
+// The groups are probed triangularly, which visits every one
+// of them because there is a power of two of them.
+static __Str_Map_Slot *strmap_find(const Str_Map *m, const char *k, uint64_t h) {
+        const size_t mask = m->tbl.cap / STRMAP_GROUP - 1;
+        size_t g = (h >> 7) & mask;
 
-        unsigned long index = m->hash(k) % m->tbl.cap;
-        __Str_Map_Node *new_bucket = malloc(sizeof(__Str_Map_Node));
+        for (size_t step = 1; ; ++step) {
+                const uint8_t *ctrl = m->tbl.ctrl + g * STRMAP_GROUP;
+                uint32_t bits = group_match(ctrl, h & 0x7f);
+                while (bits) {
+                        __Str_Map_Slot *slot = &m->tbl.slots[g * STRMAP_GROUP + __builtin_ctz(bits)];
+                        if (slot->hash == h && !strcmp(slot->k, k)) return slot;
+                        bits &= bits - 1;
+                }
+                // Nothing is ever removed, so an empty slot ends the probe.
+                if (group_match(ctrl, STRMAP_EMPTY)) return NULL;
+                g = (g + step) & mask;
+        }
+}
 
-        new_bucket->k = strdup(k);
-        new_bucket->v = v;
-        new_bucket->n = m->tbl.buckets[index];
-        m->tbl.buckets[index] = new_bucket;
+// A free slot for the hash `h`, which is not in the map.
+static __Str_Map_Slot *strmap_place(Str_Map *m, uint64_t h) {
+        const size_t mask = m->tbl.cap / STRMAP_GROUP - 1;
+        size_t g = (h >> 7) & mask;
 
-        m->tbl.len++;
+        for (size_t step = 1; ; ++step) {
+                uint8_t *ctrl = m->tbl.ctrl + g * STRMAP_GROUP;
+                uint32_t empty = group_match(ctrl, STRMAP_EMPTY);
+                if (empty) {
+                        int i = __builtin_ctz(empty);
+                        ctrl[i] = h & 0x7f;
+                        m->tbl.len++;
+                        return &m->tbl.slots[g * STRMAP_GROUP + i];
+                }
+                g = (g + step) & mask;
+        }
 }
 
-uint8_t *strmap_get(Str_Map *m, const char *k) {
+static void strmap_grow(Str_Map *m) {
+        uint8_t *ctrl = m->tbl.ctrl;
+        __Str_Map_Slot *slots = m->tbl.slots;
+        size_t cap = m->tbl.cap;
+
+        strmap_alloc(m, cap * 2);
+        for (size_t i = 0; i < cap; ++i) {
+                if (ctrl[i] != STRMAP_EMPTY) {
+                        *strmap_place(m, slots[i].hash) = slots[i];
+                }
+        }
+
+        free(ctrl);
+        free(slots);
+}
+
+char *strmap_insert(Str_Map *m, char *k, uint8_t *v) {
         if (!m || !k) return NULL;
 
-        unsigned long index = m->hash(k) % m->tbl.cap;
-        __Str_Map_Node *bucket = m->tbl.buckets[index];
+        uint64_t h = strmap_mix(m->hash(k));
+        __Str_Map_Slot *slot = strmap_find(m, k, h);
+        if (slot) {
+                m->destroy(slot->v);
+                slot->v = v;
+                return slot->k;
+        }
 
-        while (bucket) {
-                if (!strcmp(bucket->k, k)) {
-                        return bucket->v;
-                }
-                bucket = bucket->n;
+        // Keep 1/8 of the slots empty so probes stay short.
+        if (m->tbl.len + 1 > m->tbl.cap - m->tbl.cap/8) {
+                strmap_grow(m);
         }
 
-        return NULL;
+        slot = strmap_place(m, h);
+        slot->k = arena_strdup(m->keys, k);
+        slot->v = v;
+        slot->hash = h;
+        return slot->k;
 }
 
+uint8_t *strmap_get(Str_Map *m, const char *k) {
+        if (!m || !k) return NULL;
+        __Str_Map_Slot *slot = strmap_find(m, k, strmap_mix(m->hash(k)));
+        return slot ? slot->v : NULL;
+}
+
+char *strmap_key(Str_Map *m, const char *k) {
+        if (!m || !k) return NULL;
+        __Str_Map_Slot *slot = strmap_find(m, k, strmap_mix(m->hash(k)));
+        return slot ? slot->k : NULL;
+}
 
 int strmap_contains(Str_Map *m, const char *k) {
         return strmap_get(m, k) != NULL;
@@ -58,12 +156,17 @@ int strmap_contains(Str_Map *m, const char *k) {
 
 void strmap_free(Str_Map *m) {
         for (size_t i = 0; i < m->tbl.cap; ++i) {
-                if (m->tbl.buckets[i]) {
-                        free(m->tbl.buckets[i]->k);
-                        m->destroy(m->tbl.buckets[i]->v);
+                if (m->tbl.ctrl[i] != STRMAP_EMPTY) {
+                        m->destroy(m->tbl.slots[i].v);
                 }
-                free(m->tbl.buckets[i]);
         }
+        free(m->tbl.ctrl);
+        free(m->tbl.slots);
+        arena_free(m->keys);
+        m->tbl.ctrl = NULL;
+        m->tbl.slots = NULL;
+        m->keys = NULL;
+        m->tbl.len = m->tbl.cap = 0;
 }
 
 size_t strmap_len(const Str_Map *m) {